@@ -0,0 +1,166 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "header/compressor.hpp"
+#include "header/utils.hpp"
+
+using namespace std;
+
+// Times load, build, reconstruct and .qtc encode over a set of images.
+// --all runs every error method in both split modes; the PGO training run
+// uses it so the profile covers every kernel.
+//
+// quadtree_bench [--iterations N] [--method m] [--threshold t] [--min-size n] [--adaptive] [--sample] [--all] <gambar>...
+
+namespace
+{
+    struct Config
+    {
+        CompressOptions options;
+        const char* label;
+    };
+
+    double millisecondsSince(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Middle-of-range thresholds per method for --all
+    vector<Config> allConfigs()
+    {
+        const struct { ErrorMethod method; float threshold; const char* label; } methods[] = {
+            {Variance, 200.0f, "variance"}, {MAD, 20.0f, "mad"}, {MaxPixelDiff, 40.0f, "mpd"},
+            {Entropy, 5.0f, "entropy"}, {LumaVariance, 100.0f, "luma"}, {DeltaE, 8.0f, "deltae"}, {SSIM, 0.1f, "ssim"},
+        };
+        vector<Config> configs;
+        for (SplitMode mode : {QuadSplit, AdaptiveSplit})
+        {
+            for (const auto& m : methods)
+            {
+                Config c;
+                c.options.method = m.method;
+                c.options.threshold = m.threshold;
+                c.options.minSize = 4;
+                c.options.splitMode = mode;
+                c.label = m.label;
+                configs.push_back(c);
+            }
+        }
+        return configs;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 5;
+    bool all = false;
+    Config single{CompressOptions(), "custom"};
+    vector<string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--iterations" && hasValue)
+        {
+            iterations = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--method" && hasValue)
+        {
+            string name = argv[++i];
+            transform(name.begin(), name.end(), name.begin(), ::tolower);
+            replace(name.begin(), name.end(), '_', ' ');
+            if (!parseErrorMethod(name, single.options.method))
+            {
+                cerr << "Metode error tidak dikenali: " << name << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--threshold" && hasValue)
+        {
+            single.options.threshold = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--min-size" && hasValue)
+        {
+            single.options.minSize = atoi(argv[++i]);
+        }
+        else if (arg == "--adaptive")
+        {
+            single.options.splitMode = AdaptiveSplit;
+        }
+        else if (arg == "--sample")
+        {
+            single.options.sampling = true;
+        }
+        else if (arg == "--all")
+        {
+            all = true;
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty())
+    {
+        cerr << "Penggunaan: " << argv[0] << " [--iterations N] [--method m] [--threshold t] [--min-size n] [--adaptive] [--sample] [--all] <gambar>...\n";
+        return EXIT_FAILURE;
+    }
+
+    const vector<Config> configs = all ? allConfigs() : vector<Config>{single};
+    const string scratch = "quadtree_bench_tmp.qtc";
+    Compressor compressor;
+
+    cout << left << setw(28) << "gambar" << setw(10) << "metode" << setw(10) << "split"
+         << right << setw(10) << "simpul" << setw(12) << "load ms" << setw(12) << "build ms"
+         << setw(12) << "recon ms" << setw(12) << "qtc ms" << '\n';
+
+    for (const string& path : paths)
+    {
+        for (const Config& config : configs)
+        {
+            double load = 0, build = 0, recon = 0, encode = 0;
+            bool ok = true;
+            for (int it = 0; it < iterations && ok; ++it)
+            {
+                auto start = chrono::high_resolution_clock::now();
+                ok = compressor.load(path);
+                load += millisecondsSince(start);
+
+                start = chrono::high_resolution_clock::now();
+                ok = ok && compressor.build(config.options);
+                build += millisecondsSince(start);
+
+                start = chrono::high_resolution_clock::now();
+                ok = ok && compressor.encode(scratch);
+                encode += millisecondsSince(start);
+
+                start = chrono::high_resolution_clock::now();
+                ok = ok && compressor.reconstruct();
+                recon += millisecondsSince(start);
+            }
+            if (!ok)
+            {
+                cerr << path << ": " << compressor.getLastError() << '\n';
+                break;
+            }
+
+            string name = path.substr(path.find_last_of("/\\") + 1);
+            cout << left << setw(28) << name.substr(0, 27) << setw(10) << config.label
+                 << setw(10) << (config.options.splitMode == AdaptiveSplit ? "adaptive" : "quad")
+                 << right << setw(10) << compressor.getStats().nodeCount << fixed << setprecision(2)
+                 << setw(12) << load / iterations << setw(12) << build / iterations
+                 << setw(12) << recon / iterations << setw(12) << encode / iterations << '\n';
+        }
+    }
+
+    remove(scratch.c_str());
+    return 0;
+}
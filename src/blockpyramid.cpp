@@ -0,0 +1,251 @@
+#include "header/blockpyramid.hpp"
+#include "header/cpudispatch.hpp"
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+    // Moment lanes (r, g, b, a) that carry data for each native channel count
+    const int ACTIVE_LANES[5][4] = { {}, {0}, {0, 3}, {0, 1, 2}, {0, 1, 2, 3} };
+
+    int laneValue(const RGB& color, int lane)
+    {
+        switch (lane)
+        {
+        case 0: return color.r;
+        case 1: return color.g;
+        case 2: return color.b;
+        default: return color.a;
+        }
+    }
+
+    bool intersects(const Rect& a, int x, int y, int width, int height)
+    {
+        return a.x < x + width && x < a.x + a.width && a.y < y + height && y < a.y + a.height;
+    }
+}
+
+BlockPyramid::BlockPyramid() : rootBounds{0, 0, 0, 0}, minSize(1), channels(3) {}
+
+void BlockPyramid::build(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, int channels)
+{
+    this->minSize = minSize;
+    this->channels = (channels >= 1 && channels <= 4) ? channels : 3;
+    rootBounds = {x, y, width, height};
+    cells.assign(1, Cell{});
+    buildRecursive(image, 0, x, y, width, height, 0);
+}
+
+QT_MULTIVERSION void BlockPyramid::scanCell(const vector<vector<RGB>>& image, Cell& cell, int x, int y, int width, int height)
+{
+    RGB lo{INT_MAX, INT_MAX, INT_MAX, INT_MAX}, hi{0, 0, 0, 0};
+    long long sumR = 0, sumG = 0, sumB = 0, sumA = 0;
+    unsigned long long sqR = 0, sqG = 0, sqB = 0, sqA = 0;
+
+    for (int i = y; i < y + height; ++i)
+    {
+        for (int j = x; j < x + width; ++j)
+        {
+            const RGB& pixel = image[i][j];
+            lo.r = min(lo.r, pixel.r); lo.g = min(lo.g, pixel.g); lo.b = min(lo.b, pixel.b); lo.a = min(lo.a, pixel.a);
+            hi.r = max(hi.r, pixel.r); hi.g = max(hi.g, pixel.g); hi.b = max(hi.b, pixel.b); hi.a = max(hi.a, pixel.a);
+            sumR += pixel.r; sumG += pixel.g; sumB += pixel.b; sumA += pixel.a;
+            // 16-bit squares overflow int, so widen before multiplying
+            sqR += 1ULL * pixel.r * pixel.r; sqG += 1ULL * pixel.g * pixel.g; sqB += 1ULL * pixel.b * pixel.b; sqA += 1ULL * pixel.a * pixel.a;
+        }
+    }
+
+    cell.minColor = lo;
+    cell.maxColor = hi;
+    cell.sum = {sumR, sumG, sumB, sumA};
+    cell.sumSq = {sqR, sqG, sqB, sqA};
+    cell.count = 1LL * width * height;
+}
+
+void BlockPyramid::combineChildren(Cell& cell)
+{
+    RGB lo{INT_MAX, INT_MAX, INT_MAX, INT_MAX}, hi{0, 0, 0, 0};
+    cell.sum = {0, 0, 0, 0};
+    cell.sumSq = {0, 0, 0, 0};
+    cell.count = 0;
+
+    for (long long c = cell.firstChild; c < cell.firstChild + 4; ++c)
+    {
+        const Cell& child = cells[c];
+        lo.r = min(lo.r, child.minColor.r); lo.g = min(lo.g, child.minColor.g); lo.b = min(lo.b, child.minColor.b);
+        lo.a = min(lo.a, child.minColor.a); hi.a = max(hi.a, child.maxColor.a);
+        hi.r = max(hi.r, child.maxColor.r); hi.g = max(hi.g, child.maxColor.g); hi.b = max(hi.b, child.maxColor.b);
+        for (int k = 0; k < 4; ++k)
+        {
+            cell.sum[k] += child.sum[k];
+            cell.sumSq[k] += child.sumSq[k];
+        }
+        cell.count += child.count;
+    }
+    cell.minColor = lo;
+    cell.maxColor = hi;
+}
+
+void BlockPyramid::buildRecursive(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height, int depth)
+{
+    cells[cell].firstChild = -1;
+
+    // Stop where QuadTree::buildRecursive is forced to stop, or at the depth cap
+    if (width <= minSize || height <= minSize || depth == MAX_DEPTH)
+    {
+        scanCell(image, cells[cell], x, y, width, height);
+        return;
+    }
+
+    // Same geometry as QuadTreeNode::split()
+    const long long first = static_cast<long long>(cells.size());
+    cells.resize(cells.size() + 4);
+    cells[cell].firstChild = first;
+    int midW = width/2;
+    int midH = height/2;
+    buildRecursive(image, first, x, y, midW, midH, depth + 1);
+    buildRecursive(image, first + 1, x + midW, y, width - midW, midH, depth + 1);
+    buildRecursive(image, first + 2, x, y + midH, midW, height - midH, depth + 1);
+    buildRecursive(image, first + 3, x + midW, y + midH, width - midW, height - midH, depth + 1);
+    combineChildren(cells[cell]);
+}
+
+void BlockPyramid::update(const vector<vector<RGB>>& image, const Rect& dirty)
+{
+    if (cells.empty())
+    {
+        return;
+    }
+    updateRecursive(image, 0, rootBounds.x, rootBounds.y, rootBounds.width, rootBounds.height, dirty);
+}
+
+void BlockPyramid::updateRecursive(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height, const Rect& dirty)
+{
+    if (!intersects(dirty, x, y, width, height))
+    {
+        return;
+    }
+
+    const long long first = cells[cell].firstChild;
+    if (first < 0)
+    {
+        scanCell(image, cells[cell], x, y, width, height);
+        return;
+    }
+
+    int midW = width/2;
+    int midH = height/2;
+    updateRecursive(image, first, x, y, midW, midH, dirty);
+    updateRecursive(image, first + 1, x + midW, y, width - midW, midH, dirty);
+    updateRecursive(image, first + 2, x, y + midH, midW, height - midH, dirty);
+    updateRecursive(image, first + 3, x + midW, y + midH, width - midW, height - midH, dirty);
+    combineChildren(cells[cell]);
+}
+
+void BlockPyramid::clear() noexcept
+{
+    cells.clear();
+}
+
+bool BlockPyramid::empty() const noexcept
+{
+    return cells.empty();
+}
+
+long long BlockPyramid::size() const noexcept
+{
+    return static_cast<long long>(cells.size());
+}
+
+const Rect& BlockPyramid::getBounds() const noexcept
+{
+    return rootBounds;
+}
+
+long long BlockPyramid::getRoot() const noexcept
+{
+    return cells.empty() ? -1 : 0;
+}
+
+long long BlockPyramid::getChild(long long cell, int idx) const noexcept
+{
+    if (cell < 0 || idx > 3 || idx < 0 || cells[cell].firstChild < 0)
+    {
+        return -1;
+    }
+    return cells[cell].firstChild + idx;
+}
+
+long long BlockPyramid::getCount(long long cell) const noexcept
+{
+    return cells[cell].count;
+}
+
+long long BlockPyramid::getLaneSum(long long cell, int lane) const noexcept
+{
+    return cells[cell].sum[lane];
+}
+
+unsigned long long BlockPyramid::getLaneSquaredError(long long cell, int lane) const noexcept
+{
+    // Deviation from the truncated mean, as ErrorMeasurement::varianceNumerator does:
+    // sum((x - m)^2) = sumSq - 2*m*sum + n*m^2. Evaluated modulo 2^64 like
+    // sumSq itself, which gives the exact result whenever that fits.
+    const Cell& c = cells[cell];
+    const unsigned long long mean = static_cast<unsigned long long>(c.sum[lane] / c.count);
+    const unsigned long long sum = static_cast<unsigned long long>(c.sum[lane]);
+    const unsigned long long count = static_cast<unsigned long long>(c.count);
+    return c.sumSq[lane] - 2 * mean * sum + count * mean * mean;
+}
+
+RGB BlockPyramid::getMinColor(long long cell) const noexcept
+{
+    return cells[cell].minColor;
+}
+
+RGB BlockPyramid::getMaxColor(long long cell) const noexcept
+{
+    return cells[cell].maxColor;
+}
+
+RGB BlockPyramid::getAvgColor(long long cell) const noexcept
+{
+    const Cell& c = cells[cell];
+    int r = static_cast<int>(c.sum[0]/c.count);
+    int a = (channels == 2 || channels == 4) ? static_cast<int>(c.sum[3]/c.count) : 255;
+    if (channels <= 2)
+    {
+        return RGB{r, r, r, a};
+    }
+    return RGB{r, static_cast<int>(c.sum[1]/c.count), static_cast<int>(c.sum[2]/c.count), a};
+}
+
+float BlockPyramid::getMaxPixelDiff(long long cell) const noexcept
+{
+    const Cell& c = cells[cell];
+    float total = 0.0f;
+    for (int k = 0; k < channels; ++k)
+    {
+        int lane = ACTIVE_LANES[channels][k];
+        total += laneValue(c.maxColor, lane) - laneValue(c.minColor, lane);
+    }
+
+    return total / channels;
+}
+
+float BlockPyramid::getVariance(long long cell) const noexcept
+{
+    const Cell& c = cells[cell];
+    return static_cast<float>(static_cast<double>(getSquaredError(cell)) / (c.count * channels));
+}
+
+unsigned long long BlockPyramid::getSquaredError(long long cell) const noexcept
+{
+    unsigned long long total = 0;
+    for (int k = 0; k < channels; ++k)
+    {
+        total += getLaneSquaredError(cell, ACTIVE_LANES[channels][k]);
+    }
+
+    return total;
+}
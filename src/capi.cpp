@@ -0,0 +1,149 @@
+#include "header/capi.h"
+#include "header/compressor.hpp"
+#include <new>
+
+// The opaque handle is the Compressor itself
+struct qt_compressor
+{
+    Compressor compressor;
+    string error;
+};
+
+namespace
+{
+    // No C++ exception may cross the C boundary
+    template <class Body>
+    int guarded(qt_compressor* handle, Body body)
+    {
+        if (handle == nullptr)
+        {
+            return 0;
+        }
+        try
+        {
+            if (body())
+            {
+                return 1;
+            }
+            handle->error = handle->compressor.getLastError();
+        }
+        catch (const bad_alloc&)
+        {
+            handle->error = "memori tidak cukup";
+        }
+        catch (...)
+        {
+            handle->error = "galat internal";
+        }
+        return 0;
+    }
+
+    int rejectArgument(qt_compressor* handle)
+    {
+        if (handle != nullptr)
+        {
+            handle->error = "argumen tidak valid";
+        }
+        return 0;
+    }
+}
+
+qt_compressor* qt_create(void)
+{
+    return new (nothrow) qt_compressor();
+}
+
+void qt_destroy(qt_compressor* handle)
+{
+    delete handle;
+}
+
+void qt_default_options(qt_options* options)
+{
+    if (options == nullptr)
+    {
+        return;
+    }
+    CompressOptions defaults;
+    options->method = defaults.method;
+    options->threshold = defaults.threshold;
+    options->min_size = defaults.minSize;
+    options->adaptive_split = (defaults.splitMode == AdaptiveSplit) ? 1 : 0;
+    options->merge_leaves = defaults.mergeLeaves ? 1 : 0;
+    options->palette_colors = defaults.paletteColors;
+    options->sampling = defaults.sampling ? 1 : 0;
+}
+
+int qt_load(qt_compressor* handle, const char* path)
+{
+    if (path == nullptr)
+    {
+        return rejectArgument(handle);
+    }
+    return guarded(handle, [&] { return handle->compressor.load(path); });
+}
+
+int qt_load_memory(qt_compressor* handle, const unsigned char* bytes, size_t size)
+{
+    return guarded(handle, [&] { return handle->compressor.loadFromMemory(bytes, size); });
+}
+
+int qt_build(qt_compressor* handle, const qt_options* options)
+{
+    if (options == nullptr || options->method < QT_VARIANCE || options->method > QT_SSIM)
+    {
+        return rejectArgument(handle);
+    }
+    return guarded(handle, [&]
+    {
+        CompressOptions opts;
+        opts.method = static_cast<ErrorMethod>(options->method);
+        opts.threshold = options->threshold;
+        opts.minSize = options->min_size;
+        opts.splitMode = options->adaptive_split ? AdaptiveSplit : QuadSplit;
+        opts.mergeLeaves = options->merge_leaves != 0;
+        opts.paletteColors = options->palette_colors;
+        opts.sampling = options->sampling != 0;
+        return handle->compressor.build(opts);
+    });
+}
+
+int qt_save(qt_compressor* handle, const char* path)
+{
+    if (path == nullptr)
+    {
+        return rejectArgument(handle);
+    }
+    return guarded(handle, [&] { return handle->compressor.save(path); });
+}
+
+int qt_get_stats(const qt_compressor* handle, qt_stats* stats)
+{
+    if (handle == nullptr || stats == nullptr)
+    {
+        return 0;
+    }
+    const CompressStats& s = handle->compressor.getStats();
+    stats->width = s.width;
+    stats->height = s.height;
+    stats->node_count = s.nodeCount;
+    stats->leaf_count = s.leafCount;
+    stats->max_depth = s.maxDepth;
+    stats->region_count = s.regionCount;
+    stats->build_micros = s.buildMicros;
+    stats->mse = s.quality.mse;
+    stats->psnr = s.quality.psnr;
+    stats->ssim = s.quality.ssim;
+    stats->sampled_splits = s.sampling.sampled;
+    stats->expected_sampling_mistakes = s.sampling.expectedMistakes;
+    return 1;
+}
+
+const char* qt_last_error(const qt_compressor* handle)
+{
+    if (handle == nullptr)
+    {
+        return "handle kosong";
+    }
+    return handle->error.c_str();
+}
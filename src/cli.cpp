@@ -0,0 +1,286 @@
+#include "header/cli.hpp"
+#include "header/threadpool.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <cctype>
+#include <cmath>
+
+using namespace std;
+
+string getNonEmptyLine(const string& prompt)
+{
+    string input;
+    do {
+        cout << prompt;
+        getline(cin, input);
+        input = trim(input);
+    } while (input.empty());
+    return input;
+}
+
+bool processImage(const string& imagePath, vector<vector<RGB>>& image, ImageFormat& format)
+{
+    if (!loadImage(imagePath, image, format)) {
+        cerr << "Gagal memuat gambar: " << imagePath << endl;
+        return false;
+    }
+    return true;
+}
+
+bool processImages(const vector<string>& imagePaths, vector<vector<vector<RGB>>>& images, vector<ImageFormat>& formats)
+{
+    // Independent files decode concurrently, one file per worker
+    images.assign(imagePaths.size(), vector<vector<RGB>>());
+    formats.assign(imagePaths.size(), ImageFormat());
+    vector<char> loaded(imagePaths.size(), 0);
+    ThreadPool::shared().parallelFor(0, imagePaths.size(), 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            loaded[i] = processImage(imagePaths[i], images[i], formats[i]);
+            if (!loaded[i])
+            {
+                images[i].clear();
+            }
+        }
+    });
+    return find(loaded.begin(), loaded.end(), 0) == loaded.end();
+}
+
+void inputHandler(string& inputImagePath, vector<vector<RGB>>& image, ImageFormat& format,
+                  string& errorMethodStr, ErrorMethod& method, float& threshold,
+                  int& minBlockSize, SplitMode& splitMode, bool& mergeLeaves, bool& sampling,
+                  int& paletteColors, string& outputImagePath)
+{
+    // Input path
+    cout << "Masukkan path gambar input (dengan ekstensi)\n";
+    cout << "Ekstensi valid: .png, .jpg, .jpeg, .bmp, .hdr, .qoi\n\n";
+
+    while (true) {
+        inputImagePath = getNonEmptyLine("Path gambar input: ");
+        if (!fileExists(inputImagePath))
+        {
+            cout << "File tidak ditemukan.\n\n";
+        }
+        else if (!hasValidExtension(inputImagePath))
+        {
+            cout << "Ekstensi file tidak valid. Gunakan salah satu dari: .png, .jpg, .jpeg, .bmp, .hdr, .qoi\n\n";
+        }
+        else
+        {
+            break;
+        }
+    }
+    cout << endl;
+
+    // Output path
+    cout << "Masukkan path gambar output (dengan ekstensi)\n";
+    cout << "Ekstensi valid: .png, .jpg, .jpeg, .bmp, .qoi, .hdr, .qtc (quadtree terkode)\n";
+    cout << "Path output tidak boleh sama dengan path input\n\n";
+
+    while (true) {
+        outputImagePath = getNonEmptyLine("Path gambar output: ");
+
+        if (!hasValidExtension(outputImagePath) && !hasExtension(outputImagePath, ".qtc"))
+        {
+            cout << "\nEkstensi tidak valid. Gunakan salah satu dari: .png, .jpg, .jpeg, .bmp, .qoi, .hdr, .qtc\n\n";
+            continue;
+        }
+
+        if (outputImagePath == inputImagePath)
+        {
+            cout << "\nPath output tidak boleh sama dengan path input.\n\n";
+            continue;
+        }
+
+        if (fileExists(outputImagePath))
+        {
+            cout << "\nFile sudah ada. Timpa? (y/n): ";
+            string response;
+            getline(cin, response);
+            if (!response.empty() && tolower(response[0]) == 'y') break;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    cout << endl;
+
+    // Metode error
+    cout << "Pilih metode perhitungan error\n";
+    cout << "(Variance, Mean Absolute Deviation (MAD), Max Pixel Difference, Entropy,\n";
+    cout << " Luma Variance (YCbCr), Delta E (CIELAB), SSIM)\n\n";
+
+    while (true)
+    {
+        errorMethodStr = getNonEmptyLine("Metode error: ");
+        transform(errorMethodStr.begin(), errorMethodStr.end(), errorMethodStr.begin(), ::tolower);
+        if (parseErrorMethod(errorMethodStr, method))
+        {
+            break;
+        }
+        cout << "\nMetode tidak dikenali. Coba lagi.\n";
+    }
+
+    cout << endl;
+
+    // Threshold
+    while (true)
+    {
+        cout << "Masukkan nilai threshold: ";
+        string line;
+        getline(cin, line);
+        stringstream ss(line);
+        if (ss >> threshold && isValidThreshold(method, threshold)) break;
+        cout << "\nInput tidak valid. Masukkan angka desimal yang sesuai untuk threshold.\n\n";
+    }
+
+    cout << endl;
+
+    // Ukuran blok minimum
+    while (true)
+    {
+        cout << "Masukkan ukuran blok minimum: ";
+        string line;
+        getline(cin, line);
+        stringstream ss(line);
+        if (ss >> minBlockSize && minBlockSize > 1) break;
+        cout << "\nInput tidak valid. Masukkan bilangan bulat > 1.\n\n";
+    }
+
+    cout << endl;
+
+    // Mode pembagian blok
+    while (true)
+    {
+        cout << "Mode pembagian blok (quad/adaptive) [quad]: ";
+        string line;
+        getline(cin, line);
+        line = trim(line);
+        transform(line.begin(), line.end(), line.begin(), ::tolower);
+        if (line.empty() || line == "quad")
+        {
+            splitMode = QuadSplit;
+            break;
+        }
+        if (line == "adaptive")
+        {
+            splitMode = AdaptiveSplit;
+            break;
+        }
+        cout << "\nMode tidak dikenali. Pilih quad atau adaptive.\n\n";
+    }
+
+    cout << endl;
+
+    // Penggabungan leaf bertetangga, tidak untuk Entropy yang tidak bisa dihitung atas region gabungan
+    mergeLeaves = false;
+    if (method != Entropy)
+    {
+        cout << "Gabungkan leaf bertetangga yang mirip? (y/n) [n]: ";
+        string response;
+        getline(cin, response);
+        response = trim(response);
+        mergeLeaves = !response.empty() && tolower(response[0]) == 'y';
+        cout << endl;
+    }
+
+    // Estimasi dari sampel, hanya untuk metode yang memindai blok
+    sampling = false;
+    if (method == Variance || method == MAD || method == MaxPixelDiff)
+    {
+        cout << "Putuskan split blok besar dari sampel piksel? (y/n) [n]: ";
+        string response;
+        getline(cin, response);
+        response = trim(response);
+        sampling = !response.empty() && tolower(response[0]) == 'y';
+        cout << endl;
+    }
+
+    // Palet warna, hanya untuk output PNG
+    paletteColors = 0;
+    while (hasExtension(outputImagePath, ".png"))
+    {
+        cout << "Jumlah warna palet PNG (2-256, 0 = tanpa palet) [0]: ";
+        string line;
+        getline(cin, line);
+        line = trim(line);
+        stringstream ss(line);
+        if (line.empty() || (ss >> paletteColors && (paletteColors == 0 || (paletteColors >= 2 && paletteColors <= 256))))
+        {
+            break;
+        }
+        paletteColors = 0;
+        cout << "\nInput tidak valid. Masukkan 0 atau bilangan bulat 2-256.\n\n";
+    }
+
+    cout << endl;
+
+    // Baca dan proses gambar
+    auto loadStart = chrono::high_resolution_clock::now();
+    if (!processImage(inputImagePath, image, format))
+    {
+        cerr << "Gagal memproses gambar. Program dihentikan.\n";
+        exit(EXIT_FAILURE);
+    }
+    auto loadDuration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - loadStart);
+    cout << "Gambar dimuat dalam " << loadDuration.count() << " ms\n";
+}
+
+void saveCompressedImage(const vector<vector<RGB>>& image, const string& outputImagePath, const ImageFormat& format)
+{
+    if (image.empty() || image[0].empty()) {
+        std::cerr << "Galat: Data gambar kosong. Tidak dapat menyimpan.\n";
+        return;
+    }
+
+    if (!writeImage(image, outputImagePath, format)) {
+        std::cerr << "Gagal menyimpan gambar ke: " << outputImagePath << '\n';
+    } else {
+        std::cout << "Gambar berhasil disimpan ke: " << outputImagePath << '\n';
+    }
+}
+
+void outputHandler(const string& outputImagePath, const string& inputImagePath,
+                   int maxDepth, int nodeCount, chrono::milliseconds duration, int regionCount,
+                   const QualityStats* quality)
+{
+    long long inputSize = getFileSize(inputImagePath);
+    long long outputSize = getFileSize(outputImagePath);
+    long long inputSizeKB = inputSize / 1024;
+    long long outputSizeKB = outputSize / 1024;
+
+    cout << "\n\n========================= HASIL KOMPRESI =========================\n\n";
+    cout << "Gambar keluaran berhasil disimpan ke : " << outputImagePath << '\n';
+    cout << "Durasi eksekusi kompresi             : " << duration.count() << " ms\n";
+    cout << "Ukuran gambar input                  : " << inputSizeKB << " KB\n";
+    cout << "Ukuran gambar output                 : " << outputSizeKB << " KB\n";
+    cout << "Rasio kompresi                       : " << (1.0 - (double(outputSize) / double(inputSize))) * 100 << "% reduction\n";
+    cout << "Kedalaman maksimum Quadtree          : " << maxDepth << '\n';
+    cout << "Jumlah total simpul Quadtree         : " << nodeCount << '\n';
+    if (regionCount >= 0)
+    {
+        cout << "Jumlah region setelah penggabungan   : " << regionCount << '\n';
+    }
+    if (quality != nullptr)
+    {
+        cout << "MSE                                  : " << quality->mse << '\n';
+        cout << "PSNR                                 : ";
+        if (isinf(quality->psnr))
+        {
+            cout << "tak hingga (lossless)\n";
+        }
+        else
+        {
+            cout << quality->psnr << " dB\n";
+        }
+        cout << "SSIM (per leaf)                      : " << quality->ssim << '\n';
+    }
+    cout << '\n';
+    cout << "=================================================================\n";
+}
@@ -0,0 +1,174 @@
+#include "header/compressor.hpp"
+#include "header/utils.hpp"
+#include "header/leafmerge.hpp"
+#include "header/leafcoder.hpp"
+#include "header/palette.hpp"
+#include <chrono>
+
+Compressor::Compressor() : built(false) {}
+
+bool Compressor::fail(const string& message)
+{
+    lastError = message;
+    return false;
+}
+
+bool Compressor::load(const string& path)
+{
+    built = false;
+    if (!loadImage(path, image, format) || image.empty() || image[0].empty())
+    {
+        return fail("gagal memuat gambar: " + path);
+    }
+    return true;
+}
+
+bool Compressor::loadFromMemory(const unsigned char* bytes, size_t size)
+{
+    built = false;
+    if (!loadImageFromMemory(bytes, size, image, format) || image.empty() || image[0].empty())
+    {
+        return fail("gagal mendekode gambar dari memori");
+    }
+    return true;
+}
+
+bool Compressor::setImage(const vector<vector<RGB>>& pixels, const ImageFormat& imageFormat)
+{
+    built = false;
+    if (pixels.empty() || pixels[0].empty())
+    {
+        return fail("data gambar kosong");
+    }
+    image = pixels;
+    format = imageFormat;
+    return true;
+}
+
+bool Compressor::build(const CompressOptions& options)
+{
+    if (image.empty() || image[0].empty())
+    {
+        return fail("belum ada gambar yang dimuat");
+    }
+    if (!isValidThreshold(options.method, options.threshold))
+    {
+        return fail("threshold di luar rentang metode");
+    }
+    if (options.minSize < 1)
+    {
+        return fail("ukuran blok minimum harus >= 1");
+    }
+    if (options.mergeLeaves && options.method == Entropy)
+    {
+        return fail("penggabungan leaf tidak didukung untuk metode Entropy");
+    }
+    if (options.paletteColors < 0 || options.paletteColors > Palette::MAX_COLORS)
+    {
+        return fail("jumlah warna palet harus 0-256");
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    stats = CompressStats();
+    stats.width = static_cast<int>(image[0].size());
+    stats.height = static_cast<int>(image.size());
+    tree.setSampling(options.sampling);
+    tree.buildTree(image, 0, 0, stats.width, stats.height, options.method, options.threshold, options.minSize, options.splitMode, format);
+    stats.sampling = tree.getSamplingStats();
+    if (options.mergeLeaves)
+    {
+        stats.regionCount = LeafMerge::mergeLeaves(tree, image);
+    }
+    if (options.paletteColors > 0 && format.sampleMax <= 255)
+    {
+        stats.paletteColors = Palette::quantize(tree, options.paletteColors);
+    }
+    stats.buildMicros = chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+
+    vector<QuadTreeNode*> leaves;
+    tree.collectLeaves(leaves);
+    stats.leafCount = static_cast<int>(leaves.size());
+    stats.nodeCount = tree.getNodeCount();
+    stats.maxDepth = tree.getMaxDepth();
+    built = true;
+    return true;
+}
+
+bool Compressor::reconstruct()
+{
+    if (!built)
+    {
+        return fail("quadtree belum dibangun");
+    }
+    tree.reconstructImage(image, output, &stats.quality);
+    return true;
+}
+
+bool Compressor::save(const string& path)
+{
+    if (hasExtension(path, ".qtc"))
+    {
+        return encode(path) && reconstruct();
+    }
+    if (!reconstruct())
+    {
+        return false;
+    }
+    if (stats.paletteColors > 0 && hasExtension(path, ".png"))
+    {
+        if (!Palette::writeIndexed(tree, path))
+        {
+            return fail("gagal menyimpan gambar berpalet: " + path);
+        }
+        return true;
+    }
+    if (!writeImage(output, path, format))
+    {
+        return fail("gagal menyimpan gambar: " + path);
+    }
+    return true;
+}
+
+bool Compressor::encode(const string& path)
+{
+    if (!built)
+    {
+        return fail("quadtree belum dibangun");
+    }
+    string error;
+    if (!LeafCoder::encode(tree, path, &error))
+    {
+        return fail(error);
+    }
+    return true;
+}
+
+const vector<vector<RGB>>& Compressor::getImage() const noexcept
+{
+    return image;
+}
+
+const vector<vector<RGB>>& Compressor::getOutput() const noexcept
+{
+    return output;
+}
+
+const ImageFormat& Compressor::getFormat() const noexcept
+{
+    return format;
+}
+
+const CompressStats& Compressor::getStats() const noexcept
+{
+    return stats;
+}
+
+const QuadTree& Compressor::getTree() const noexcept
+{
+    return tree;
+}
+
+const string& Compressor::getLastError() const noexcept
+{
+    return lastError;
+}
@@ -0,0 +1,168 @@
+#include "header/daemon.hpp"
+#include "header/utils.hpp"
+#include "header/compressor.hpp"
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+
+namespace
+{
+    struct Job
+    {
+        string input, output;
+        CompressOptions options;
+    };
+
+    // Parses one request line; on failure error holds the reason
+    bool parseJob(const string& line, Job& job, string& error)
+    {
+        istringstream fields(line);
+        string methodStr, thresholdStr, minSizeStr;
+        if (!(fields >> job.input >> job.output >> methodStr >> thresholdStr >> minSizeStr))
+        {
+            error = "format: <input> <output> <metode> <threshold> <ukuran_blok_min> [quad|adaptive] [merge] [sample] [palette[=N]]";
+            return false;
+        }
+
+        transform(methodStr.begin(), methodStr.end(), methodStr.begin(), ::tolower);
+        replace(methodStr.begin(), methodStr.end(), '_', ' ');
+        if (!parseErrorMethod(methodStr, job.options.method))
+        {
+            error = "metode error tidak dikenali: " + methodStr;
+            return false;
+        }
+
+        if (!(istringstream(thresholdStr) >> job.options.threshold) || !isValidThreshold(job.options.method, job.options.threshold))
+        {
+            error = "threshold tidak valid: " + thresholdStr;
+            return false;
+        }
+        if (!(istringstream(minSizeStr) >> job.options.minSize) || job.options.minSize <= 1)
+        {
+            error = "ukuran blok minimum harus bilangan bulat > 1";
+            return false;
+        }
+        if (!hasValidExtension(job.output) && !hasExtension(job.output, ".qtc"))
+        {
+            error = "ekstensi output tidak valid: " + job.output;
+            return false;
+        }
+
+        string option;
+        while (fields >> option)
+        {
+            transform(option.begin(), option.end(), option.begin(), ::tolower);
+            if (option == "adaptive")
+            {
+                job.options.splitMode = AdaptiveSplit;
+            }
+            else if (option == "quad")
+            {
+                job.options.splitMode = QuadSplit;
+            }
+            else if (option == "merge")
+            {
+                job.options.mergeLeaves = true;
+            }
+            else if (option == "sample")
+            {
+                job.options.sampling = true;
+            }
+            else if (option == "palette")
+            {
+                job.options.paletteColors = 256;
+            }
+            else if (option.compare(0, 8, "palette=") == 0)
+            {
+                if (!(istringstream(option.substr(8)) >> job.options.paletteColors) || job.options.paletteColors < 2 || job.options.paletteColors > 256)
+                {
+                    error = "jumlah warna palet harus 2-256: " + option;
+                    return false;
+                }
+            }
+            else
+            {
+                error = "opsi tidak dikenali: " + option;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    long long microsecondsSince(chrono::high_resolution_clock::time_point start)
+    {
+        return chrono::duration_cast<chrono::microseconds>(chrono::high_resolution_clock::now() - start).count();
+    }
+}
+
+int Daemon::serve(istream& in, ostream& out)
+{
+    // Tree, caches and image rows stay warm across jobs
+    Compressor compressor;
+
+    string line;
+    while (getline(in, line))
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        if (line == "quit" || line == "exit")
+        {
+            break;
+        }
+
+        Job job;
+        string error;
+        if (!parseJob(line, job, error))
+        {
+            out << "ERR " << error << endl;
+            continue;
+        }
+
+        auto start = chrono::high_resolution_clock::now();
+        if (!compressor.load(job.input))
+        {
+            out << "ERR " << compressor.getLastError() << endl;
+            continue;
+        }
+        long long loadUs = microsecondsSince(start);
+
+        start = chrono::high_resolution_clock::now();
+        if (!compressor.build(job.options))
+        {
+            out << "ERR " << compressor.getLastError() << endl;
+            continue;
+        }
+        long long buildUs = microsecondsSince(start);
+
+        start = chrono::high_resolution_clock::now();
+        if (!compressor.save(job.output))
+        {
+            out << "ERR " << compressor.getLastError() << endl;
+            continue;
+        }
+        long long writeUs = microsecondsSince(start);
+
+        const CompressStats& stats = compressor.getStats();
+        out << "OK " << job.output << " nodes=" << stats.nodeCount << " depth=" << stats.maxDepth
+            << " load_us=" << loadUs << " build_us=" << buildUs << " write_us=" << writeUs
+            << " bytes=" << getFileSize(job.output) << " psnr=" << stats.quality.psnr
+            << " ssim=" << stats.quality.ssim;
+        if (job.options.sampling)
+        {
+            out << " sampled=" << stats.sampling.sampled << " fallbacks=" << stats.sampling.fallbacks;
+        }
+        out << endl;
+    }
+
+    return 0;
+}
+
+int Daemon::daemonHandler(int, char*[])
+{
+    // stdout carries only protocol lines; diagnostics go to stderr
+    ios::sync_with_stdio(false);
+    return serve(cin, cout);
+}
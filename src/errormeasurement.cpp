@@ -1,132 +1,674 @@
 #include "header/errormeasurement.hpp"
+#include "header/cpudispatch.hpp"
+#include <limits>
+#include <climits>
+#include <cstring>
+#include <cstdint>
 
-RGB ErrorMeasurement::computeAvgColor(const vector<vector<RGB>>& image, int x, int y, int width, int height)
+ColorSpace ErrorMeasurement::getColorSpace(ErrorMethod method)
 {
-    long long sumR = 0, sumG = 0, sumB = 0;
-    int totalPixels = width * height;
-
-    for (int i = y; i < y + height; ++i)
+    switch (method)
     {
-        for (int j = x; j < x + width; ++j)
-        {
-            const RGB& pixel = image[i][j];
-            sumR += pixel.r;
-            sumG += pixel.g;
-            sumB += pixel.b;
-        }
+    case LumaVariance:
+        return YCbCr;
+    case DeltaE:
+        return CIELab;
+    default:
+        return SRGB;
     }
-    
-    return RGB{
-        static_cast<int>(sumR/totalPixels),
-        static_cast<int>(sumG/totalPixels),
-        static_cast<int>(sumB/totalPixels)
-    };
 }
 
-float ErrorMeasurement::computeVariance(const vector<vector<RGB>>& image, int x, int y, int width, int height)
+namespace
 {
-    float varR = 0.0f, varG = 0.0f, varB = 0.0f;
-    int totalPixels = width * height;
-    RGB mean = computeAvgColor(image, x, y, width, height);
+    // Native channel layout: gray lives in r (mirrored into g and b), alpha in a.
+    // Each kernel below is instantiated once per channel count so grayscale
+    // only touches one value per pixel.
+    template <int Channels>
+    inline void loadChannels(const RGB& pixel, int (&v)[Channels]);
+
+    template <>
+    inline void loadChannels<1>(const RGB& pixel, int (&v)[1]) { v[0] = pixel.r; }
+
+    template <>
+    inline void loadChannels<2>(const RGB& pixel, int (&v)[2]) { v[0] = pixel.r; v[1] = pixel.a; }
+
+    template <>
+    inline void loadChannels<3>(const RGB& pixel, int (&v)[3]) { v[0] = pixel.r; v[1] = pixel.g; v[2] = pixel.b; }
+
+    template <>
+    inline void loadChannels<4>(const RGB& pixel, int (&v)[4]) { v[0] = pixel.r; v[1] = pixel.g; v[2] = pixel.b; v[3] = pixel.a; }
 
-    for (int i = y; i < y + height; ++i)
+    template <int Channels>
+    inline RGB storeChannels(const int (&v)[Channels]);
+
+    template <>
+    inline RGB storeChannels<1>(const int (&v)[1]) { return RGB{v[0], v[0], v[0], 255}; }
+
+    template <>
+    inline RGB storeChannels<2>(const int (&v)[2]) { return RGB{v[0], v[0], v[0], v[1]}; }
+
+    template <>
+    inline RGB storeChannels<3>(const int (&v)[3]) { return RGB{v[0], v[1], v[2], 255}; }
+
+    template <>
+    inline RGB storeChannels<4>(const int (&v)[4]) { return RGB{v[0], v[1], v[2], v[3]}; }
+
+    template <int Channels>
+    void channelMeans(const vector<vector<RGB>>& image, int x, int y, int width, int height, int (&mean)[Channels])
     {
-        for (int j = x; j < x + width; ++j)
+        long long sum[Channels] = {};
+        const long long totalPixels = static_cast<long long>(width) * height;
+        int v[Channels];
+
+        for (int i = y; i < y + height; ++i)
         {
-            const RGB& pixel = image[i][j];
-            varR += pow(pixel.r - mean.r, 2);
-            varG += pow(pixel.g - mean.g, 2);
-            varB += pow(pixel.b - mean.b, 2);
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[i][j], v);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    sum[k] += v[k];
+                }
+            }
+        }
+
+        for (int k = 0; k < Channels; ++k)
+        {
+            mean[k] = static_cast<int>(sum[k]/totalPixels);
         }
     }
 
-    varR /= totalPixels;
-    varG /= totalPixels;
-    varB /= totalPixels;
+    template <int Channels>
+    RGB avgColorKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height)
+    {
+        int mean[Channels];
+        channelMeans<Channels>(image, x, y, width, height, mean);
+        return storeChannels<Channels>(mean);
+    }
 
-    return (varR + varG + varB) / 3;
-}
+    // The kernels below stop as soon as their running value reaches limit.
+    // Their accumulators only grow, so an early result is already >= limit
+    // and the split decision matches a full scan. The check runs once per
+    // row to keep the inner loop free of branches.
+    //
+    // Variance and MAD return integer numerators: the per-channel sums of
+    // squared / absolute deviations from the truncated mean, added over the
+    // channels. They are exact for any block size and scan order.
 
-float ErrorMeasurement::computeMAD(const vector<vector<RGB>>& image, int x, int y, int width, int height)
-{
-    float madR = 0.0f, madG = 0.0f, madB = 0.0f;
-    int totalPixels = width * height;
-    RGB mean = computeAvgColor(image, x, y, width, height);
+    template <int Channels>
+    unsigned long long varianceNumeratorKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height, unsigned long long limit)
+    {
+        // One pass over sums and sums of squares. The rows read so far have
+        // no smaller squared deviation about the block mean than about their
+        // own mean, S2 - S1^2/n, so that bound may stop the scan before the
+        // block mean is known. It is taken in double with a margin well past
+        // the rounding of both terms, so it never overstates.
+        long long sum[Channels] = {};
+        // 16-bit squares overflow int, so widen before multiplying
+        unsigned long long sumSq[Channels] = {};
+        int v[Channels];
+        const bool bounded = limit < numeric_limits<unsigned long long>::max();
+
+        for (int i = y; i < y + height; ++i)
+        {
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[i][j], v);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    sum[k] += v[k];
+                    sumSq[k] += 1ULL * v[k] * v[k];
+                }
+            }
+            if (bounded && i + 1 < y + height)
+            {
+                const double n = static_cast<double>(width) * (i - y + 1);
+                double bound = 0.0, margin = 1.0 + static_cast<double>(limit) * 1e-15;
+                for (int k = 0; k < Channels; ++k)
+                {
+                    const double s = static_cast<double>(sum[k]);
+                    const double q = static_cast<double>(sumSq[k]);
+                    bound += q - s * s / n;
+                    margin += (q + s * s / n) * 1e-15;
+                }
+                if (bound - margin >= static_cast<double>(limit))
+                {
+                    return limit;
+                }
+            }
+        }
 
-    for (int i = y; i < y + height; ++i)
+        // sum((v - m)^2) = sumSq - 2*m*sum + n*m^2, modulo 2^64 like sumSq,
+        // which is exact since the result fits
+        const unsigned long long count = 1ULL * width * height;
+        unsigned long long total = 0;
+        for (int k = 0; k < Channels; ++k)
+        {
+            const unsigned long long mean = static_cast<unsigned long long>(sum[k]) / count;
+            total += sumSq[k] - 2 * mean * static_cast<unsigned long long>(sum[k]) + count * mean * mean;
+        }
+        return total;
+    }
+
+    // Means pass for MAD that can already settle a split. For any center m,
+    // |a - m| + |b - m| >= |a - b|, so the differences between each row of
+    // the top half and its partner in the bottom half bound the numerator
+    // from below before the mean is known. Returns true with that bound in
+    // reached once it hits limit; otherwise fills mean.
+    template <int Channels>
+    bool madMeansOrBound(const vector<vector<RGB>>& image, int x, int y, int width, int height, unsigned long long limit, int (&mean)[Channels], unsigned long long& reached)
     {
-        for (int j = x; j < x + width; ++j)
+        long long sum[Channels] = {};
+        unsigned long long diff[Channels] = {};
+        int a[Channels], b[Channels];
+        const int half = height / 2;
+
+        for (int i = y; i < y + half; ++i)
+        {
+            const RGB* top = image[i].data() + x;
+            const RGB* bottom = image[i + half].data() + x;
+            for (int j = 0; j < width; ++j)
+            {
+                loadChannels<Channels>(top[j], a);
+                loadChannels<Channels>(bottom[j], b);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    sum[k] += a[k] + b[k];
+                    diff[k] += abs(a[k] - b[k]);
+                }
+            }
+            unsigned long long total = 0;
+            for (int k = 0; k < Channels; ++k)
+            {
+                total += diff[k];
+            }
+            if (total >= limit)
+            {
+                reached = total;
+                return true;
+            }
+        }
+        if (height % 2 != 0)
         {
-            const RGB& pixel = image[i][j];
-            madR += abs(pixel.r - mean.r);
-            madG += abs(pixel.g - mean.g);
-            madB += abs(pixel.b - mean.b);
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[y + height - 1][j], a);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    sum[k] += a[k];
+                }
+            }
         }
+
+        const long long totalPixels = static_cast<long long>(width) * height;
+        for (int k = 0; k < Channels; ++k)
+        {
+            mean[k] = static_cast<int>(sum[k]/totalPixels);
+        }
+        return false;
     }
 
-    madR /= totalPixels;
-    madG /= totalPixels;
-    madB /= totalPixels;
+    // With a known mean (from IntegralImage) this is a single pass;
+    // otherwise madMeansOrBound comes first and may already decide
+    template <int Channels>
+    unsigned long long madNumeratorKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height, unsigned long long limit, const RGB* knownMean)
+    {
+        unsigned long long sad[Channels] = {};
+        int mean[Channels];
+        if (knownMean != nullptr)
+        {
+            loadChannels<Channels>(*knownMean, mean);
+        }
+        else
+        {
+            unsigned long long reached;
+            if (madMeansOrBound<Channels>(image, x, y, width, height, limit, mean, reached))
+            {
+                return reached;
+            }
+        }
+        int v[Channels];
+        unsigned long long total = 0;
+
+        for (int i = y; i < y + height; ++i)
+        {
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[i][j], v);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    sad[k] += abs(v[k] - mean[k]);
+                }
+            }
+            total = 0;
+            for (int k = 0; k < Channels; ++k)
+            {
+                total += sad[k];
+            }
+            if (total >= limit)
+            {
+                return total;
+            }
+        }
 
-    return (madR + madG + madB) / 3;
-}
+        return total;
+    }
 
-float ErrorMeasurement::computeMaxPixelDiff(const vector<vector<RGB>>& image, int x, int y, int width, int height)
-{
-    int minR = 255, minG = 255, minB = 255;
-    int maxR = 0, maxG = 0, maxB = 0;
-    int totalPixels = width * height;
-    RGB mean = computeAvgColor(image, x, y, width, height);
-    
-    for (int i = y; i < y + height; ++i)
+    template <int Channels>
+    float finishRange(const int (&lo)[Channels], const int (&hi)[Channels])
     {
-        for (int j = x; j < x + width; ++j)
+        float total = 0.0f;
+        for (int k = 0; k < Channels; ++k)
         {
-            const RGB& pixel = image[i][j];
-            minR = min(minR, image[i][j].r); minG = min(minG, image[i][j].g); minB = min(minB, image[i][j].b);
-            maxR = max(maxR, image[i][j].r); maxG = max(maxG, image[i][j].g); maxB = max(maxB, image[i][j].b);
+            total += hi[k] - lo[k];
         }
+        return total / Channels;
     }
-    
-    float D_R = maxR - minR;
-    float D_G = maxG - minG;
-    float D_B = maxB - minB;
-    
-    return (D_R + D_G + D_B) / 3.0f;
-} 
 
-float ErrorMeasurement::computeEntropy(const vector<vector<RGB>>& image, int x, int y, int width, int height)
-{
-    const int CHANNEL_RANGE = 256;
-    array<int, CHANNEL_RANGE> histR{}, histG{}, histB{};
-    int totalPixels = width * height;
-    if (totalPixels <= 0)
+    template <int Channels>
+    float maxPixelDiffKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height, float limit)
     {
-        return 0.0f;
+        int lo[Channels], hi[Channels];
+        fill(lo, lo + Channels, numeric_limits<int>::max());
+        fill(hi, hi + Channels, 0);
+        int v[Channels];
+        const bool bounded = limit < numeric_limits<float>::infinity();
+
+        for (int i = y; i < y + height; ++i)
+        {
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[i][j], v);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    lo[k] = min(lo[k], v[k]);
+                    hi[k] = max(hi[k], v[k]);
+                }
+            }
+            if (bounded)
+            {
+                float partial = finishRange<Channels>(lo, hi);
+                if (partial >= limit)
+                {
+                    return partial;
+                }
+            }
+        }
+
+        return finishRange<Channels>(lo, hi);
+    }
+
+    // Deeper samples are binned down to 256 levels so entropy keeps its 0..8 range
+    template <int Channels, typename Count>
+    float blockEntropy(const vector<vector<RGB>>& image, int x, int y, int width, int height, int sampleMax)
+    {
+        const int CHANNEL_RANGE = 256;
+        array<array<Count, CHANNEL_RANGE>, Channels> hist{};
+        const long long totalPixels = static_cast<long long>(width) * height;
+        int v[Channels];
+        const long long levels = static_cast<long long>(sampleMax) + 1;
+
+        for (int i = y; i < y + height; ++i)
+        {
+            for (int j = x; j < x + width; ++j)
+            {
+                loadChannels<Channels>(image[i][j], v);
+                for (int k = 0; k < Channels; ++k)
+                {
+                    ++hist[k][(v[k] * static_cast<long long>(CHANNEL_RANGE)) / levels];
+                }
+            }
+        }
+
+        float total = 0.0f;
+        for (int k = 0; k < Channels; ++k)
+        {
+            float entropy = 0.0f;
+            for (Count freq : hist[k])
+            {
+                if (freq > 0)
+                {
+                    float p = static_cast<float>(freq) / totalPixels;
+                    entropy -= p * log2f(p);
+                }
+            }
+            total += entropy;
+        }
+        return total / Channels;
     }
 
-    for (int i = y; i < y + height && i < image.size(); ++i) {
-        for (int j = x; j < x + width && j < image[i].size(); ++j) {
-            const RGB& pixel = image[i][j];
-            ++histR[pixel.r];
-            ++histG[pixel.g];
-            ++histB[pixel.b];
+    // Bitwise comparison of whole pixels, two 64-bit words each. Differences
+    // are OR-ed over a row so the inner loop has no branch and vectorizes;
+    // the first row with a difference ends the scan.
+    template <int Channels>
+    bool uniformKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height, RGB& color)
+    {
+        static_assert(sizeof(RGB) == 2 * sizeof(uint64_t), "RGB is compared as two 64-bit words");
+        uint64_t first[2];
+        memcpy(first, &image[y][x], sizeof(first));
+
+        for (int i = y; i < y + height; ++i)
+        {
+            const unsigned char* row = reinterpret_cast<const unsigned char*>(image[i].data() + x);
+            uint64_t diff = 0;
+            for (int j = 0; j < width; ++j)
+            {
+                uint64_t word[2];
+                memcpy(word, row + j * sizeof(RGB), sizeof(word));
+                diff |= (word[0] ^ first[0]) | (word[1] ^ first[1]);
+            }
+            if (diff != 0)
+            {
+                return false;
+            }
         }
+
+        // The mean of identical samples, in the layout computeAvgColor returns
+        int v[Channels];
+        loadChannels<Channels>(image[y][x], v);
+        color = storeChannels<Channels>(v);
+        return true;
     }
 
-    auto calcEntropy = [totalPixels](const array<int, CHANNEL_RANGE>& hist) -> float
+    // Subsample for the approximate mode: SAMPLE_GRID x SAMPLE_GRID strata
+    // and a block must give every stratum at least MIN_STRATUM_SIDE pixels
+    // per side before sampling beats scanning
+    const int SAMPLE_GRID = 16;
+    const int SAMPLE_COUNT = SAMPLE_GRID * SAMPLE_GRID;
+    const int MIN_STRATUM_SIDE = 4;
+    const double SAMPLE_Z = 3.0;
+    // One-sided normal tail beyond SAMPLE_Z
+    const double SAMPLE_MISS_RATE = 0.00135;
+    // R2 sequence (plastic number), a 2-D low-discrepancy offset per stratum
+    const double R2_A1 = 0.7548776662466927;
+    const double R2_A2 = 0.5698402909980532;
+
+    template <int Channels>
+    bool sampleKernel(ErrorMethod method, const vector<vector<RGB>>& image, int x, int y, int width, int height, float limit)
     {
-        float entropy = 0.0f;
-        for (int freq : hist)
+        array<array<int, Channels>, SAMPLE_COUNT> samples;
+        double mean[Channels] = {};
+        int lo[Channels], hi[Channels];
+        fill(lo, lo + Channels, numeric_limits<int>::max());
+        fill(hi, hi + Channels, 0);
+        int v[Channels];
+
+        for (int s = 0; s < SAMPLE_COUNT; ++s)
+        {
+            const int row = s / SAMPLE_GRID, col = s % SAMPLE_GRID;
+            const int x0 = x + static_cast<int>(static_cast<long long>(width) * col / SAMPLE_GRID);
+            const int x1 = x + static_cast<int>(static_cast<long long>(width) * (col + 1) / SAMPLE_GRID);
+            const int y0 = y + static_cast<int>(static_cast<long long>(height) * row / SAMPLE_GRID);
+            const int y1 = y + static_cast<int>(static_cast<long long>(height) * (row + 1) / SAMPLE_GRID);
+            double u = 0.5 + s * R2_A1, t = 0.5 + s * R2_A2;
+            u -= floor(u);
+            t -= floor(t);
+            loadChannels<Channels>(image[y0 + static_cast<int>(t * (y1 - y0))][x0 + static_cast<int>(u * (x1 - x0))], v);
+            for (int k = 0; k < Channels; ++k)
+            {
+                samples[s][k] = v[k];
+                mean[k] += v[k];
+                lo[k] = min(lo[k], v[k]);
+                hi[k] = max(hi[k], v[k]);
+            }
+        }
+
+        // Every sampled range is inside the block's range
+        if (method == MaxPixelDiff)
+        {
+            return finishRange<Channels>(lo, hi) >= limit;
+        }
+
+        for (int k = 0; k < Channels; ++k)
         {
-            if (freq > 0)
+            mean[k] /= SAMPLE_COUNT;
+        }
+        // Per-pixel contribution to the block error, averaged over channels
+        double sum = 0.0, sumSq = 0.0;
+        for (const auto& sample : samples)
+        {
+            double q = 0.0;
+            for (int k = 0; k < Channels; ++k)
             {
-                float p = static_cast<float>(freq) / totalPixels;
-                entropy -= p * log2f(p);
+                double d = sample[k] - mean[k];
+                q += (method == Variance) ? d * d : fabs(d);
             }
+            q /= Channels;
+            sum += q;
+            sumSq += q * q;
+        }
+        double estimate = sum / SAMPLE_COUNT;
+        double spread = max(0.0, sumSq / SAMPLE_COUNT - estimate * estimate);
+        double margin = SAMPLE_Z * sqrt(spread / (SAMPLE_COUNT - 1));
+        if (method == Variance)
+        {
+            // Deviations from the sample mean understate the variance
+            estimate *= static_cast<double>(SAMPLE_COUNT) / (SAMPLE_COUNT - 1);
+        }
+        else
+        {
+            // The exact MAD is taken about the truncated mean, up to 1 away
+            margin += 1.0;
+        }
+        return estimate - margin >= limit;
+    }
+
+    // int bins while every count fits, so small blocks clear half the memory
+    template <int Channels>
+    float entropyKernel(const vector<vector<RGB>>& image, int x, int y, int width, int height, int sampleMax)
+    {
+        const long long totalPixels = static_cast<long long>(width) * height;
+        if (totalPixels <= 0)
+        {
+            return 0.0f;
+        }
+        if (totalPixels <= INT_MAX)
+        {
+            return blockEntropy<Channels, int>(image, x, y, width, height, sampleMax);
         }
-        return entropy;
-    };
+        return blockEntropy<Channels, long long>(image, x, y, width, height, sampleMax);
+    }
+}
+
+#define DISPATCH_CHANNELS(kernel, channels, ...)            \
+    switch (channels)                                       \
+    {                                                       \
+    case 1: return kernel<1>(__VA_ARGS__);                  \
+    case 2: return kernel<2>(__VA_ARGS__);                  \
+    case 4: return kernel<4>(__VA_ARGS__);                  \
+    default: return kernel<3>(__VA_ARGS__);                 \
+    }
+
+float ErrorMeasurement::normalizeError(ErrorMethod method, float error, int sampleMax)
+{
+    // Express errors of deeper images in 8-bit units so one threshold range fits all depths
+    if (sampleMax == 255)
+    {
+        return error;
+    }
+    double scale = 255.0 / sampleMax;
+    switch (method)
+    {
+    case Variance:
+    case LumaVariance:
+        return static_cast<float>(error * scale * scale);
+    case MAD:
+    case MaxPixelDiff:
+        return static_cast<float>(error * scale);
+    default:
+        return error;
+    }
+}
+
+unsigned long long ErrorMeasurement::numeratorLimit(ErrorMethod method, float threshold, int sampleMax, int channels, long long pixels)
+{
+    // error < threshold  <=>  numerator < threshold * scale^p * channels * pixels,
+    // with the numerator an integer the right side can be rounded up. For
+    // 8-bit images and blocks under 2^29 samples the product is exact in a
+    // double; either way it is computed once per block with no divide.
+    double scale = static_cast<double>(sampleMax) / 255.0;
+    double unit = (method == Variance) ? scale * scale : scale;
+    double limit = ceil(static_cast<double>(threshold) * unit * (static_cast<double>(channels) * pixels));
+    if (!(limit > 0.0))
+    {
+        return 0;
+    }
+    if (limit >= static_cast<double>(numeric_limits<unsigned long long>::max()))
+    {
+        return numeric_limits<unsigned long long>::max();
+    }
+    return static_cast<unsigned long long>(limit);
+}
+
+float ErrorMeasurement::kernelLimit(ErrorMethod method, float threshold, int sampleMax)
+{
+    if (sampleMax == 255 || !(threshold < numeric_limits<float>::infinity()))
+    {
+        return threshold;
+    }
+    // Undo normalizeError, rounded up a little so that any kernel value at
+    // or above the limit still normalizes to at least threshold
+    const double ROUNDING_MARGIN = 1.0 + 1e-5;
+    double scale = sampleMax / 255.0;
+    switch (method)
+    {
+    case Variance:
+    case LumaVariance:
+        return static_cast<float>(threshold * scale * scale * ROUNDING_MARGIN);
+    case MAD:
+    case MaxPixelDiff:
+        return static_cast<float>(threshold * scale * ROUNDING_MARGIN);
+    default:
+        return threshold;
+    }
+}
+
+QT_MULTIVERSION RGB ErrorMeasurement::computeAvgColor(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels)
+{
+    DISPATCH_CHANNELS(avgColorKernel, channels, image, x, y, width, height)
+}
+
+QT_MULTIVERSION unsigned long long ErrorMeasurement::varianceNumerator(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, unsigned long long limit)
+{
+    DISPATCH_CHANNELS(varianceNumeratorKernel, channels, image, x, y, width, height, limit)
+}
+
+QT_MULTIVERSION unsigned long long ErrorMeasurement::madNumerator(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, unsigned long long limit, const RGB* mean)
+{
+    DISPATCH_CHANNELS(madNumeratorKernel, channels, image, x, y, width, height, limit, mean)
+}
+
+float ErrorMeasurement::computeVariance(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels)
+{
+    long long samples = static_cast<long long>(width) * height * channels;
+    return static_cast<float>(static_cast<double>(varianceNumerator(image, x, y, width, height, channels)) / samples);
+}
+
+float ErrorMeasurement::computeMAD(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels)
+{
+    long long samples = static_cast<long long>(width) * height * channels;
+    return static_cast<float>(static_cast<double>(madNumerator(image, x, y, width, height, channels)) / samples);
+}
+
+QT_MULTIVERSION float ErrorMeasurement::computeMaxPixelDiff(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, float limit)
+{
+    DISPATCH_CHANNELS(maxPixelDiffKernel, channels, image, x, y, width, height, limit)
+}
+
+QT_MULTIVERSION bool ErrorMeasurement::isUniform(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, RGB& color)
+{
+    DISPATCH_CHANNELS(uniformKernel, channels, image, x, y, width, height, color)
+}
+
+bool ErrorMeasurement::canSample(ErrorMethod method, int width, int height)
+{
+    const int minSide = SAMPLE_GRID * MIN_STRATUM_SIDE;
+    return (method == Variance || method == MAD || method == MaxPixelDiff) && width >= minSide && height >= minSide;
+}
+
+bool ErrorMeasurement::sampleReaches(ErrorMethod method, const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, float limit)
+{
+    DISPATCH_CHANNELS(sampleKernel, channels, method, image, x, y, width, height, limit)
+}
+
+double ErrorMeasurement::sampleMissRate(ErrorMethod method)
+{
+    return (method == MaxPixelDiff) ? 0.0 : SAMPLE_MISS_RATE;
+}
+
+QT_MULTIVERSION float ErrorMeasurement::computeEntropy(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, int sampleMax)
+{
+    DISPATCH_CHANNELS(entropyKernel, channels, image, x, y, width, height, sampleMax)
+}
+
+float ErrorMeasurement::withAlpha(int channels, float colorError, float alphaError)
+{
+    if (channels != 2 && channels != 4)
+    {
+        return colorError;
+    }
+    const float colorLanes = (channels == 2) ? 1.0f : 3.0f;
+    return (colorLanes * colorError + alphaError) / (colorLanes + 1.0f);
+}
+
+float ErrorMeasurement::computeVariance(const BlockMoments& rgb)
+{
+    float varR = rgb.getVariance(0);
+    float varG = rgb.getVariance(1);
+    float varB = rgb.getVariance(2);
+
+    return withAlpha(rgb.channels, (varR + varG + varB) / 3, rgb.getVariance(3));
+}
+
+float ErrorMeasurement::computeLumaVariance(const BlockMoments& ycbcr)
+{
+    // Chroma errors are much less visible than luma errors, so weight Y twice as much
+    float varY = ycbcr.getVariance(0);
+    float varCb = ycbcr.getVariance(1);
+    float varCr = ycbcr.getVariance(2);
+
+    return withAlpha(ycbcr.channels, 0.5f * varY + 0.25f * varCb + 0.25f * varCr, ycbcr.getVariance(3));
+}
+
+float ErrorMeasurement::computeDeltaE(const BlockMoments& lab)
+{
+    // RMS CIE76 distance between each pixel and the block's mean Lab color,
+    // with alpha (on the 0..100 scale of L) as one more axis
+    float varL = lab.getVariance(0);
+    float varA = lab.getVariance(1);
+    float varB = lab.getVariance(2);
+    float varAlpha = lab.hasAlpha() ? static_cast<float>(lab.getVariance(3)) : 0.0f;
+
+    return sqrtf(varL + varA + varB + varAlpha);
+}
+
+double ErrorMeasurement::computeFlatSSIM(double meanX, double meanY, double varianceX, int sampleMax)
+{
+    const double C1 = (0.01 * sampleMax) * (0.01 * sampleMax);
+    const double C2 = (0.03 * sampleMax) * (0.03 * sampleMax);
+
+    double luminance = (2 * meanX * meanY + C1) / (meanX * meanX + meanY * meanY + C1);
+    double contrastStructure = C2 / (varianceX + C2);
+    return luminance * contrastStructure;
+}
+
+float ErrorMeasurement::computeSSIM(const BlockMoments& rgb, int sampleMax)
+{
+    // SSIM between the block x and the flat leaf y = avg color that would replace it.
+    // y is constant, so sigma_y = 0 and the cross term sigma_xy = E[xy] - mu_x*mu_y = 0.
+    if (rgb.count <= 0)
+    {
+        return 0.0f;
+    }
+
+    double ssim[4] = {};
+    for (int c = 0; c < (rgb.hasAlpha() ? 4 : 3); ++c)
+    {
+        double muX = rgb.getMean(c);
+        double muY = floor(muX); // same truncation as calculateAvgColor
+        ssim[c] = computeFlatSSIM(muX, muY, rgb.getVariance(c), sampleMax);
+    }
 
-    return (calcEntropy(histR) + calcEntropy(histG) + calcEntropy(histB)) / 3.0f;
+    const float color = static_cast<float>((ssim[0] + ssim[1] + ssim[2]) / 3.0);
+    return 1.0f - withAlpha(rgb.channels, color, static_cast<float>(ssim[3]));
 }
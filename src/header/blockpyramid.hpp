@@ -0,0 +1,72 @@
+#ifndef BLOCKPYRAMID_HPP
+#define BLOCKPYRAMID_HPP
+
+#include <vector>
+#include <array>
+#include "quadtree.hpp"
+
+using namespace std;
+
+// Per-channel min/max and integer moments of every block the quadtree can
+// visit down to MAX_DEPTH levels below the root, children in the order
+// QuadTreeNode::split() produces them and always after their parent.
+// Built bottom-up once per image, so each node's channel range, variance and
+// mean color are answered in O(1). Blocks below the cap have no cell
+// (getChild() returns -1) and are measured directly, which bounds the
+// pyramid to about 1.4M cells (~160 MB) however large the image is. Edits
+// are folded in with update(), which only touches the cells that overlap
+// the edited rectangle.
+class BlockPyramid
+{
+    private:
+        struct Cell
+        {
+            RGB minColor;
+            RGB maxColor;
+            array<long long, 4> sum;
+            // May wrap on huge 16-bit blocks; only differences that fit are read from it
+            array<unsigned long long, 4> sumSq;
+            long long count;
+            // The four children are stored next to each other; -1 for cells the pyramid does not split
+            long long firstChild;
+        };
+
+        vector<Cell> cells;
+        Rect rootBounds;
+        int minSize;
+        int channels;
+
+        void buildRecursive(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height, int depth);
+        void updateRecursive(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height, const Rect& dirty);
+        void scanCell(const vector<vector<RGB>>& image, Cell& cell, int x, int y, int width, int height);
+        void combineChildren(Cell& cell);
+
+    public:
+        // 4^10 blocks at the deepest level: a 4096x4096 image is covered down to 4x4
+        static const int MAX_DEPTH = 10;
+
+        BlockPyramid();
+
+        void build(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, int channels = 3);
+        void update(const vector<vector<RGB>>& image, const Rect& dirty);
+        void clear() noexcept;
+        bool empty() const noexcept;
+
+        long long size() const noexcept;
+        const Rect& getBounds() const noexcept;
+        long long getRoot() const noexcept;
+        long long getChild(long long cell, int idx) const noexcept;
+        long long getCount(long long cell) const noexcept;
+        long long getLaneSum(long long cell, int lane) const noexcept;
+        // Sum of squared deviations from the truncated mean of one lane
+        unsigned long long getLaneSquaredError(long long cell, int lane) const noexcept;
+        RGB getMinColor(long long cell) const noexcept;
+        RGB getMaxColor(long long cell) const noexcept;
+        RGB getAvgColor(long long cell) const noexcept;
+        float getMaxPixelDiff(long long cell) const noexcept;
+        float getVariance(long long cell) const noexcept;
+        // Sum of squared deviations from the mean color, over the active channels
+        unsigned long long getSquaredError(long long cell) const noexcept;
+};
+
+#endif
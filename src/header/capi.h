@@ -0,0 +1,70 @@
+#ifndef QUADTREE_CAPI_H
+#define QUADTREE_CAPI_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Thin C ABI over Compressor. Functions returning int yield 1 on success and
+   0 on failure; qt_last_error then describes the failure. A handle must not
+   be used from two threads at once. */
+
+typedef struct qt_compressor qt_compressor;
+
+enum qt_method
+{
+    QT_VARIANCE = 0,
+    QT_MAD = 1,
+    QT_MAX_PIXEL_DIFF = 2,
+    QT_ENTROPY = 3,
+    QT_LUMA_VARIANCE = 4,
+    QT_DELTA_E = 5,
+    QT_SSIM = 6
+};
+
+typedef struct qt_options
+{
+    int method;          /* enum qt_method */
+    float threshold;
+    int min_size;
+    int adaptive_split;  /* 0 = quad, 1 = adaptive binary split */
+    int merge_leaves;    /* not with QT_ENTROPY: qt_build fails */
+    int palette_colors;  /* 0 = full color, else 2..256; .png output becomes indexed */
+    int sampling;        /* 1 = split large blocks on subsample evidence */
+} qt_options;
+
+typedef struct qt_stats
+{
+    int width;
+    int height;
+    int node_count;
+    int leaf_count;
+    int max_depth;
+    int region_count;    /* -1 when leaves were not merged */
+    long long build_micros;
+    double mse;          /* quality of the last qt_save, over the active channels */
+    double psnr;         /* inf when lossless */
+    double ssim;         /* area-weighted per-leaf SSIM */
+    int sampled_splits;  /* splits decided from a subsample (sampling on) */
+    double expected_sampling_mistakes;
+} qt_stats;
+
+qt_compressor* qt_create(void);
+void qt_destroy(qt_compressor* handle);
+
+void qt_default_options(qt_options* options);
+
+int qt_load(qt_compressor* handle, const char* path);
+int qt_load_memory(qt_compressor* handle, const unsigned char* bytes, size_t size);
+int qt_build(qt_compressor* handle, const qt_options* options);
+int qt_save(qt_compressor* handle, const char* path);
+int qt_get_stats(const qt_compressor* handle, qt_stats* stats);
+const char* qt_last_error(const qt_compressor* handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef CLI_HPP
+#define CLI_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include "utils.hpp"
+
+using namespace std;
+
+// Console front end: interactive prompts, progress messages and summaries.
+// Kept apart from utils so the library never reads stdin or calls exit().
+
+string getNonEmptyLine(const string& prompt);
+
+// As loadImage, but reports failures on stderr
+bool processImage(const string& imagePath, vector<vector<RGB>>& image, ImageFormat& format);
+// Loads independent files concurrently, one file per worker. A file that
+// fails to load is left empty; the result is true when all of them loaded.
+bool processImages(const vector<string>& imagePaths, vector<vector<vector<RGB>>>& images, vector<ImageFormat>& formats);
+
+void inputHandler(string& inputImagePath, vector<vector<RGB>>& image, ImageFormat& format,
+                  string& errorMethodStr, ErrorMethod& method, float& threshold,
+                  int& minBlockSize, SplitMode& splitMode, bool& mergeLeaves, bool& sampling,
+                  int& paletteColors, string& outputImagePath);
+
+void saveCompressedImage(const vector<vector<RGB>>& image, const string& outputImagePath, const ImageFormat& format = ImageFormat());
+
+void outputHandler(const string &outputImagePath, const string &inputImagePath,
+                   int maxDepth, int nodeCount, chrono::milliseconds duration, int regionCount = -1,
+                   const QualityStats* quality = nullptr);
+
+#endif // CLI_HPP
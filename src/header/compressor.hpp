@@ -0,0 +1,84 @@
+#ifndef COMPRESSOR_HPP
+#define COMPRESSOR_HPP
+
+#include <string>
+#include <vector>
+#include "quadtree.hpp"
+
+using namespace std;
+
+struct CompressOptions
+{
+    ErrorMethod method = Variance;
+    float threshold = 200.0f;
+    int minSize = 4;
+    SplitMode splitMode = QuadSplit;
+    bool mergeLeaves = false;
+    // Split large blocks on subsample evidence (QuadTree::setSampling)
+    bool sampling = false;
+    // Quantize leaf colors to at most this many (8-bit images only); 0 keeps them
+    int paletteColors = 0;
+};
+
+struct CompressStats
+{
+    int width = 0;
+    int height = 0;
+    int nodeCount = 0;
+    int leafCount = 0;
+    int maxDepth = 0;
+    int regionCount = -1;
+    int paletteColors = 0;
+    SamplingStats sampling;
+    long long buildMicros = 0;
+    // Filled in by reconstruct() and save()
+    QualityStats quality;
+};
+
+// Library entry point: load an image, build its tree, then reconstruct, save
+// or encode it. Failures are reported through return values and
+// getLastError(); nothing is read from stdin or written to stdout. One
+// instance keeps its buffers and caches warm across images and is not meant
+// to be shared between threads.
+class Compressor
+{
+    private:
+        QuadTree tree;
+        vector<vector<RGB>> image;
+        // Leaf colors from the last reconstruct(); image stays the source so
+        // the next build() still compresses the original pixels
+        vector<vector<RGB>> output;
+        ImageFormat format;
+        CompressStats stats;
+        string lastError;
+        bool built;
+
+        bool fail(const string& message);
+
+    public:
+        Compressor();
+
+        bool load(const string& path);
+        bool loadFromMemory(const unsigned char* bytes, size_t size);
+        bool setImage(const vector<vector<RGB>>& pixels, const ImageFormat& imageFormat = ImageFormat());
+
+        bool build(const CompressOptions& options);
+
+        // Fills the output image with the leaf colors, measuring quality
+        // against the loaded image, which is left untouched
+        bool reconstruct();
+        // Reconstructs and writes the output image, or encodes the tree when
+        // the path ends in .qtc; either way the output ends up reconstructed.
+        // A quantized tree saved as .png is written as an indexed PNG.
+        bool save(const string& path);
+        bool encode(const string& path);
+
+        const vector<vector<RGB>>& getImage() const noexcept;
+        const vector<vector<RGB>>& getOutput() const noexcept;
+        const ImageFormat& getFormat() const noexcept;
+        const CompressStats& getStats() const noexcept;
+        const QuadTree& getTree() const noexcept;
+        const string& getLastError() const noexcept;
+};
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef CPUDISPATCH_HPP
+#define CPUDISPATCH_HPP
+
+// QT_MULTIVERSION compiles a hot kernel once per x86-64 ISA level and binds
+// the best one for the running CPU at load time (GCC function multiversioning
+// through ifunc). flatten pulls the templated inner loops into every clone so
+// they are vectorized for that level too. The build enables it with
+// QT_TARGET_CLONES; elsewhere the macro expands to nothing.
+#if defined(QT_TARGET_CLONES) && defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#define QT_MULTIVERSION __attribute__((target_clones("default", "arch=x86-64-v2", "arch=x86-64-v3"), flatten))
+#else
+#define QT_MULTIVERSION
+#endif
+
+#endif
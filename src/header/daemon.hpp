@@ -0,0 +1,30 @@
+#ifndef DAEMON_HPP
+#define DAEMON_HPP
+
+#include <iostream>
+#include "quadtree.hpp"
+
+using namespace std;
+
+namespace Daemon
+{
+    // Serves compression jobs read line by line from in, one response line per
+    // job on out. The tree, its error caches, the image rows and the node
+    // storage stay allocated between jobs.
+    //
+    // Request : <input> <output> <metode> <threshold> <ukuran_blok_min> [quad|adaptive] [merge] [sample] [palette[=N]]
+    // Response: OK <output> nodes=<n> depth=<d> load_us=<t> build_us=<t> write_us=<t> bytes=<n>
+    //              psnr=<dB> ssim=<s> [sampled=<n> fallbacks=<n>]
+    //           ERR <pesan>
+    // The OK response is a single line; psnr is "inf" when the output is lossless.
+    // sample turns on sampled split decisions and adds their counts to the
+    // response. palette writes an indexed PNG of 256 colors, palette=N one of 2 to 256.
+    // Method names containing spaces are written with '_' (max_pixel_difference).
+    // An empty line or one starting with '#' is ignored; "quit" ends the loop.
+    int serve(istream& in, ostream& out);
+
+    // main.exe --daemon
+    int daemonHandler(int argc, char* argv[]);
+}
+
+#endif
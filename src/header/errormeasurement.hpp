@@ -5,16 +5,60 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <limits>
 #include "quadtree.hpp"
+#include "integralimage.hpp"
 
 using namespace std;
 
 namespace ErrorMeasurement { 
-    RGB computeAvgColor(const vector<vector<RGB>>& image, int x, int y, int width, int height);
-    float computeVariance(const vector<vector<RGB>>& image, int x, int y, int width, int height); 
-    float computeMAD(const vector<vector<RGB>>& image, int x, int y, int width, int height); 
-    float computeMaxPixelDiff(const vector<vector<RGB>>& image, int x, int y, int width, int height); 
-    float computeEntropy(const vector<vector<RGB>>& image, int x, int y, int width, int height); 
+    ColorSpace getColorSpace(ErrorMethod method);
+    float normalizeError(ErrorMethod method, float error, int sampleMax);
+    // Threshold in the units the kernels return (before normalizeError)
+    float kernelLimit(ErrorMethod method, float threshold, int sampleMax);
+    RGB computeAvgColor(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3);
+    // Exact integer numerators of variance and MAD: the error is the
+    // numerator divided by width * height * channels. numeratorLimit turns a
+    // threshold into the smallest numerator that is not below it, so the
+    // split test is one integer compare. Like the scans below, the numerator
+    // scans may stop early once they reach limit. madNumerator takes the
+    // block's mean color (as computeAvgColor gives it) when the caller
+    // already has it, which saves a pass.
+    unsigned long long varianceNumerator(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3, unsigned long long limit = numeric_limits<unsigned long long>::max());
+    unsigned long long madNumerator(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3, unsigned long long limit = numeric_limits<unsigned long long>::max(), const RGB* mean = nullptr);
+    unsigned long long numeratorLimit(ErrorMethod method, float threshold, int sampleMax, int channels, long long pixels);
+    float computeVariance(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3); 
+    float computeMAD(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3); 
+    // With a finite limit these may stop early and return any value >= limit
+    // once the block is known to reach it; below the limit they are exact.
+    float computeMaxPixelDiff(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3, float limit = numeric_limits<float>::infinity()); 
+    // True when every pixel of the block is bitwise equal to the first; color
+    // is then the block's mean as computeAvgColor would give it. Costs one
+    // compare per pixel and stops at the first differing row.
+    bool isUniform(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, RGB& color);
+    // Stratified subsample test for QuadTree's approximate mode. One pixel
+    // is taken from each cell of a fixed grid over the block, at a
+    // low-discrepancy offset, so the result is deterministic. sampleReaches
+    // is true when the sample shows the block's error reaching limit
+    // (kernel units): for MaxPixelDiff the sampled range is a lower bound,
+    // so the answer is certain; for Variance and MAD the estimate minus a
+    // z = 3 normal confidence margin must reach it, so each positive answer
+    // is wrong with probability about sampleMissRate.
+    bool canSample(ErrorMethod method, int width, int height);
+    bool sampleReaches(ErrorMethod method, const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels, float limit);
+    double sampleMissRate(ErrorMethod method);
+    float computeEntropy(const vector<vector<RGB>>& image, int x, int y, int width, int height, int channels = 3, int sampleMax = 255); 
+    // Moment-based errors average over the image's native channels like the
+    // kernels do: withAlpha weighs a per-color-plane error against the alpha
+    // error, gray counting once and RGB three times
+    float withAlpha(int channels, float colorError, float alphaError);
+    float computeVariance(const BlockMoments& rgb);
+    float computeLumaVariance(const BlockMoments& ycbcr);
+    float computeDeltaE(const BlockMoments& lab);
+    float computeSSIM(const BlockMoments& rgb, int sampleMax = 255);
+    // SSIM of a block against a flat block of color meanY: no variance and no
+    // covariance on the flat side, leaving the luminance and contrast terms
+    double computeFlatSSIM(double meanX, double meanY, double varianceX, int sampleMax = 255);
 }
 
 #endif
@@ -0,0 +1,86 @@
+#ifndef INTEGRALIMAGE_HPP
+#define INTEGRALIMAGE_HPP
+
+#include <vector>
+#include <array>
+#include "quadtree.hpp"
+
+using namespace std;
+
+enum ColorSpace : int
+{
+    SRGB,
+    YCbCr,
+    CIELab
+};
+
+// Count, per-channel sums and sums of squares of a pixel set. Moments of
+// disjoint sets add, so they describe merged regions as well as rectangles.
+// Channels 0-2 are the color planes, channel 3 is alpha and stays zero
+// unless the source image has one.
+struct BlockMoments
+{
+    double count = 0.0;
+    array<double, 4> sum{};
+    array<double, 4> sumSq{};
+    // Native channel count of the source image (1-4)
+    int channels = 3;
+
+    double getMean(int channel) const noexcept;
+    double getVariance(int channel) const noexcept;
+    bool hasAlpha() const noexcept;
+    BlockMoments& operator+=(const BlockMoments& other) noexcept;
+};
+
+// Summed-area tables of an image's three color channels converted once into
+// the requested color space, plus an alpha plane for gray+alpha and RGBA
+// images (scaled to 0..100 next to Lab, raw otherwise). Block sums, means
+// and variances are O(1) per query. Edited rectangles are layered on top as
+// small delta tables instead of rewriting the whole table; after a few
+// edits the tables are rebuilt.
+class IntegralImage
+{
+    private:
+        struct Patch
+        {
+            Rect area;
+            size_t stride;
+            array<vector<double>, 4> sum;
+            array<vector<double>, 4> sumSq;
+        };
+
+        ColorSpace space;
+        ImageFormat format;
+        int width, height;
+        size_t stride;
+        // 3, or 4 when the image has alpha
+        int planes;
+        array<vector<double>, 4> sum;
+        array<vector<double>, 4> sumSq;
+        vector<Patch> patches;
+        long long patchedArea;
+
+        double rectSum(const vector<double>& table, int x, int y, int w, int h) const noexcept;
+        double patchSum(bool squares, int channel, int x, int y, int w, int h) const noexcept;
+
+    public:
+        IntegralImage();
+
+        void build(const vector<vector<RGB>>& image, ColorSpace space, const ImageFormat& format = ImageFormat());
+        void update(const vector<vector<RGB>>& image, const Rect& dirty);
+        void clear() noexcept;
+        bool empty() const noexcept;
+
+        ColorSpace getColorSpace() const noexcept;
+        int getWidth() const noexcept;
+        int getHeight() const noexcept;
+        bool hasAlpha() const noexcept;
+
+        double getSum(int channel, int x, int y, int w, int h) const noexcept;
+        double getSumSq(int channel, int x, int y, int w, int h) const noexcept;
+        double getMean(int channel, int x, int y, int w, int h) const noexcept;
+        double getVariance(int channel, int x, int y, int w, int h) const noexcept;
+        BlockMoments getMoments(int x, int y, int w, int h) const noexcept;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef LEAFCODER_HPP
+#define LEAFCODER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "quadtree.hpp"
+
+using namespace std;
+
+// Compact .qtc container for a built quadtree. Split decisions are coded per
+// node with depth contexts, leaf colors as residuals against a median
+// predictor over already decoded neighbors, everything through an adaptive
+// binary range coder. A tree with merged regions (LeafMerge) is written as
+// QTC2: each leaf then either joins a region already decoded along its left
+// or top edge or opens a new one, so every region color is coded once. On
+// failure the reason is stored in *error when given; nothing is printed.
+namespace LeafCoder
+{
+    bool encode(const QuadTree& tree, const string& path, string* error = nullptr);
+    bool encode(const QuadTree& tree, vector<uint8_t>& data, string* error = nullptr);
+
+    // Largest image the decoders allocate by default, in pixels. A header
+    // asking for more is rejected before any allocation, as is data that
+    // ends before the coded tree does.
+    const long long MAX_DECODE_PIXELS = 1LL << 30;
+
+    // Rebuilds the flat-leaf image stored in a .qtc file
+    bool decode(const string& path, vector<vector<RGB>>& image, ImageFormat& format, string* error = nullptr,
+                long long maxPixels = MAX_DECODE_PIXELS);
+
+    // Sequence frames (.qtd), quad split only. A frame holds the subtrees
+    // that changed since the previous one (in leaf order), placed by a change
+    // map over the quad partition and coded as above with their neighbors
+    // predicted from canvas, the previous decoded frame, which both sides
+    // update in place. A keyframe starts a new canvas and holds the root.
+    bool encodeFrame(const QuadTree& tree, const vector<QuadTreeNode*>& subtrees, bool keyframe,
+                     vector<vector<RGB>>& canvas, vector<uint8_t>& data, string* error = nullptr);
+    bool decodeFrame(const vector<uint8_t>& data, vector<vector<RGB>>& canvas, ImageFormat& format, string* error = nullptr,
+                     long long maxPixels = MAX_DECODE_PIXELS);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LEAFMERGE_HPP
+#define LEAFMERGE_HPP
+
+#include <vector>
+#include "quadtree.hpp"
+
+using namespace std;
+
+namespace LeafMerge
+{
+    // Fuses spatially adjacent leaves whose union still satisfies the tree's
+    // error threshold and recolors every leaf with its region's mean color.
+    // Subtrees that end up inside one region collapse into a single leaf,
+    // and the regions are stored on the tree (QuadTree::getLeafRegions) for
+    // LeafCoder. Returns the number of regions, or -1 without touching the
+    // tree if its error method cannot be evaluated on merged regions
+    // (Entropy).
+    int mergeLeaves(QuadTree& tree, const vector<vector<RGB>>& image);
+}
+
+#endif
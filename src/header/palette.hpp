@@ -0,0 +1,28 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+#include <string>
+#include "quadtree.hpp"
+
+using namespace std;
+
+// Indexed-color output. A reconstructed quadtree has one color per leaf, so
+// the palette is built from the leaf list (weighted by leaf area) instead of
+// from pixels, and the index image is filled leaf by leaf.
+namespace Palette
+{
+    const int MAX_COLORS = 256;
+
+    // Median cut over the distinct leaf colors. Rewrites every leaf's color
+    // to its palette entry, so a later reconstruct or .qtc encode sees the
+    // quantized image. Returns the palette size; nothing changes when the
+    // tree already has at most maxColors colors.
+    int quantize(QuadTree& tree, int maxColors = MAX_COLORS);
+
+    // Writes an 8-bit indexed PNG straight from the leaves. Fails when the
+    // tree has more than 256 distinct colors (call quantize first) or its
+    // samples are deeper than 8 bits.
+    bool writeIndexed(const QuadTree& tree, const string& path);
+}
+
+#endif
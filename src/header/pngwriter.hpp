@@ -0,0 +1,34 @@
+#ifndef PNGWRITER_HPP
+#define PNGWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Minimal PNG encoder for the layouts stb_image_write cannot produce
+// (16-bit samples, indexed color, images past 2 GB). Compression goes
+// through stb's deflate; data too large for it is stored uncompressed.
+namespace PngWriter
+{
+    enum ColorType
+    {
+        Gray = 0,
+        Truecolor = 2,
+        Indexed = 3,
+        GrayAlpha = 4,
+        TruecolorAlpha = 6
+    };
+
+    ColorType colorTypeFor(int channels);
+
+    // rows: height rows of tightly packed samples, big-endian when bitDepth is 16.
+    // palette: RGB triplets, required for Indexed.
+    // transparency: optional alpha per palette entry (tRNS), Indexed only.
+    bool write(const string& path, int width, int height, ColorType colorType, int bitDepth,
+               const vector<uint8_t>& rows, const vector<uint8_t>& palette = vector<uint8_t>(),
+               const vector<uint8_t>& transparency = vector<uint8_t>());
+}
+
+#endif
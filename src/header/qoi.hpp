@@ -0,0 +1,23 @@
+#ifndef QOI_HPP
+#define QOI_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// "Quite OK Image" codec: lossless, byte-oriented and an order of magnitude
+// faster than deflate. Flat quadtree leaves turn into long runs, which QOI
+// stores in one byte per 62 pixels.
+namespace Qoi
+{
+    // pixels: width*height tightly packed RGB or RGBA samples (channels 3 or 4)
+    bool encode(const uint8_t* pixels, int width, int height, int channels, vector<uint8_t>& out);
+
+    bool isQoi(const uint8_t* bytes, size_t size);
+    // Decodes to the channel count stored in the header
+    bool decode(const uint8_t* bytes, size_t size, vector<uint8_t>& pixels, int& width, int& height, int& channels);
+}
+
+#endif
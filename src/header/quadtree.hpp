@@ -7,12 +7,32 @@
 #include <utility>
 #include <stdexcept>
 #include <memory>
+#include <limits>
 
 using namespace std;
 
+class BlockPyramid;
+class IntegralImage;
+enum ColorSpace : int;
+
+// One pixel, whatever the image's channel count: gray images repeat the
+// level in r, g and b, and images without alpha leave a at its maximum.
+// Keeping alpha in the struct costs 4 bytes per pixel on opaque images but
+// gives every kernel one 16-byte layout (see README).
 struct RGB
 {
     int r, g, b;
+    int a = 255;
+};
+
+// How samples in an RGB image are to be interpreted. 8-bit images use
+// 0..255; 16-bit and HDR images use 0..65535, HDR samples being linear
+// radiance multiplied by hdrScale.
+struct ImageFormat
+{
+    int channels = 3;
+    int sampleMax = 255;
+    float hdrScale = 0.0f;
 };
 
 struct Rect
@@ -25,7 +45,42 @@ enum ErrorMethod
     Variance,
     MAD,
     MaxPixelDiff,
-    Entropy
+    Entropy,
+    LumaVariance,
+    DeltaE,
+    SSIM
+};
+
+enum SplitMode
+{
+    QuadSplit,
+    AdaptiveSplit
+};
+
+// Outcome of one rate-distortion pruning pass: squared error summed over the
+// pixels and active channels, and the estimated coded size in bits
+struct RDCost
+{
+    double distortion = 0.0;
+    double bits = 0.0;
+};
+
+// Reconstruction quality over the active channels. SSIM is computed per leaf
+// (each leaf being a window compared against its flat color) and weighted by
+// leaf area. PSNR is infinite for a lossless result.
+struct QualityStats
+{
+    double mse = 0.0;
+    double psnr = 0.0;
+    double ssim = 1.0;
+};
+
+// Outcome of a build with sampling enabled (QuadTree::setSampling)
+struct SamplingStats
+{
+    int sampled = 0;                // blocks split on the evidence of a subsample
+    int fallbacks = 0;              // large blocks whose subsample was inconclusive
+    double expectedMistakes = 0.0;  // bound on the expected number of wrong sampled splits
 };
 
 class QuadTreeNode
@@ -34,6 +89,9 @@ class QuadTreeNode
         Rect bounds;
         bool isLeaf;
         RGB avgColor;
+        // Lower bound on the error that made this node split, 0 when unknown;
+        // fills the padding before childNode, so nodes stay 72 bytes
+        float splitError;
         array<QuadTreeNode*, 4> childNode;
 
     public:
@@ -41,48 +99,164 @@ class QuadTreeNode
         QuadTreeNode(int x, int y, int width, int height);
         ~QuadTreeNode();
 
+        // Node storage is recycled through a per-thread free list, so rebuilding
+        // a tree reuses the blocks the previous tree released
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size) noexcept;
+
         const Rect& getBounds() const noexcept;
         bool isLeafNode() const noexcept;
         bool hasChildren() const noexcept;
         RGB getAvgColor() const noexcept;
+        float getSplitError() const noexcept;
         QuadTreeNode* getChild(int idx) const noexcept;
 
         void setAvgColor(RGB avgColor) noexcept;
+        void setSplitError(float error) noexcept;
         void setLeaf(bool isLeaf) noexcept;
         void setChild(int idx, QuadTreeNode* node) noexcept;
         void setBounds(int x, int y, int width, int height) noexcept;
 
         void split();
-        RGB calculateAvgColor(const vector<vector<RGB>>& image) const;
+        void splitAt(bool vertical, int position);
+        void clearChildren();
+        RGB calculateAvgColor(const vector<vector<RGB>>& image, int channels = 3) const;
 };
 
 class QuadTree
 {
     private:
         QuadTreeNode* root;
-        int threshold;
+        float threshold;
         int minSize;
+        ErrorMethod method;
+        ImageFormat format;
+        unique_ptr<BlockPyramid> pyramid;
+        unique_ptr<IntegralImage> integral;
+        SplitMode splitMode;
+        // Per-block caches of the full quad tree, indexed like the pyramid
+        vector<double> cellDistortion;
+        vector<float> cellBits;
+        vector<double> cellSSIM;
+        vector<float> cellErrors;
+        vector<unsigned long long> cellNumerators;
+        vector<double> rdCost;
+        vector<char> cellSplit;
+        bool sampling;
+        SamplingStats samplingStats;
+        // Region id of every leaf in collectLeaves order, empty when unmerged
+        vector<int> leafRegions;
+        int regionCount;
+
+        bool chooseSplit(const IntegralImage& stats, int x, int y, int width, int height, bool& vertical, int& position) const;
+        float cellError(long long cell) const;
+        // Whether a block is worth an isUniform scan before it is measured
+        bool checksFlat(long long cell) const noexcept;
+        QuadTreeNode* updateRecursive(QuadTreeNode* node, const vector<vector<RGB>>& image, const Rect& dirty, long long cell);
+        bool staysSplit(QuadTreeNode* node, const Rect& dirty) const;
+        bool keepsLeaf(const QuadTreeNode* leaf, const vector<vector<RGB>>& current);
+        QuadTreeNode* refreshRecursive(QuadTreeNode* node, const vector<vector<RGB>>& previous, const vector<vector<RGB>>& current, vector<QuadTreeNode*>& rebuilt);
+        QuadTreeNode* buildFromCells(long long cell, int x, int y, int width, int height, RDCost& total) const;
+        void prepareCells(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, const ImageFormat& format);
+        void collectCellErrors(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height);
+        // buildRecursive's stop rule replayed on a cached block
+        bool cellBelow(long long cell, float threshold) const;
+        bool hasThresholdCache() const noexcept;
+        void dropRegions() noexcept;
 
     public:
         QuadTree();
         ~QuadTree();
 
         QuadTreeNode* getRoot() const noexcept;
-        int getThreshold() const noexcept;
+        float getThreshold() const noexcept;
         int getMinSize() const noexcept;
+        SplitMode getSplitMode() const noexcept;
+        ErrorMethod getMethod() const noexcept;
+        int getChannels() const noexcept;
+        const ImageFormat& getFormat() const noexcept;
+
+        // Approximate mode for the scanning stop rules (Variance, MAD and
+        // MaxPixelDiff outside the pyramid path): large blocks are split
+        // without a full scan when a subsample already shows, with high
+        // confidence, that their error reaches the threshold. Everything
+        // else, and every leaf, is still decided exactly.
+        void setSampling(bool enabled) noexcept;
+        const SamplingStats& getSamplingStats() const noexcept;
 
         int getMaxDepth() const;
         int getMaxDepth(QuadTreeNode* node) const;
 
         int getNodeCount() const;
         int getNodeCount(QuadTreeNode* node) const;
+        void collectLeaves(vector<QuadTreeNode*>& leaves) const;
+
+        // Regions left by LeafMerge: ids 0..count-1, one per leaf in
+        // collectLeaves order, and the leaves of a region all carry its color.
+        // Every call that rebuilds or edits the tree drops them.
+        void setLeafRegions(vector<int> regions, int count);
+        const vector<int>& getLeafRegions() const noexcept;
+        int getRegionCount() const noexcept;
+        const IntegralImage& getIntegral(const vector<vector<RGB>>& image, ColorSpace space);
+
+        // With a finite bound the scan may stop once the error is known to
+        // reach it; the result is then only good for an "error < bound" test
+        float calculateError(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, float bound = numeric_limits<float>::infinity());
+        // The stop rule "error < threshold" for the current method; Variance
+        // and MAD decide it exactly on integer numerators. measured receives a
+        // lower bound on the block's error (0 when only sampled); Variance and
+        // MAD keep scanning until that bound reaches reach, when it is higher
+        // than the threshold.
+        bool belowThreshold(const vector<vector<RGB>>& image, int x, int y, int width, int height, long long cell = -1, float* measured = nullptr, float reach = 0.0f);
+
+        void buildTree(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, float threshold, int minSize, SplitMode splitMode = QuadSplit, const ImageFormat& format = ImageFormat());
+        QuadTreeNode* buildRecursive(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, long long cell = -1);
 
-        float calculateError(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method);
+        // Rate-distortion mode. prepareRateDistortion gathers distortion and
+        // estimated leaf bits for every block of the full quad tree down to
+        // minSize; pruneRateDistortion then keeps the subtree minimizing
+        // D + lambda*R in one bottom-up pass and rebuilds the nodes from it,
+        // so different lambdas can be tried without touching the image again.
+        void prepareRateDistortion(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, const ImageFormat& format = ImageFormat());
+        RDCost pruneRateDistortion(double lambda);
 
-        void buildTree(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, int threshold, int minSize);
-        QuadTreeNode* buildRecursive(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method);
+        // Threshold search. prepareThresholdSearch additionally caches the
+        // method's error for every splittable block; estimateQuality replays
+        // the greedy stop rule for a threshold over the cache without building
+        // nodes, and pruneThreshold builds the tree buildTree would produce for
+        // that threshold (quad split only).
+        void prepareThresholdSearch(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, int minSize, const ImageFormat& format = ImageFormat());
+        void collectSplitErrors(vector<float>& errors) const;
+        QualityStats estimateQuality(float threshold) const;
+        void pruneThreshold(float threshold);
 
-        void reconstructImage(vector<vector<RGB>>& image);
+        // Brings the tree in line with an image edited inside dirtyRect; the
+        // result is the tree buildTree would give for the edited image. Only
+        // nodes overlapping the edit are visited. For Variance, MAD and
+        // Entropy a split node whose recorded error minus the most the edit
+        // could remove still reaches the threshold is kept without a rescan,
+        // and rescans record up to three times the threshold, so over a run
+        // of small edits the large ancestors are rescanned only now and then.
+        // Other nodes are measured again, in O(1) on the pyramid and
+        // integral-image paths. In adaptive mode the cut of every visited
+        // split node is chosen again and the subtree rebuilt when it moves.
+        void update(const vector<vector<RGB>>& image, const Rect& dirtyRect);
+        // Carries the tree over to the next frame of a sequence. A leaf whose
+        // pixels changed keeps its color while the block still meets the
+        // threshold on the new frame and that color is within its noise;
+        // otherwise it is rebuilt. A node whose children were rebuilt into
+        // leaves collapses when it now passes the threshold itself. rebuilt
+        // receives the roots of the new subtrees, in leaf order; every other
+        // leaf kept its color.
+        int updateFromFrame(const vector<vector<RGB>>& previous, const vector<vector<RGB>>& current, vector<QuadTreeNode*>& rebuilt);
+        // With quality set, every pixel is compared against the value it
+        // replaces before the leaf color is written, so reconstructing over
+        // the source image measures the result in the same pass
+        void reconstructImage(vector<vector<RGB>>& image, QualityStats* quality = nullptr);
+        // Same, but leaves source untouched and writes the leaf colors to
+        // image (resized to the tree when it does not fit); quality compares
+        // against source
+        void reconstructImage(const vector<vector<RGB>>& source, vector<vector<RGB>>& image, QualityStats* quality = nullptr);
         void reconstructRecursive(QuadTreeNode* node, vector<vector<RGB>>& image);
 };
 
@@ -0,0 +1,45 @@
+#ifndef RATEDISTORTION_HPP
+#define RATEDISTORTION_HPP
+
+#include <cstddef>
+#include "quadtree.hpp"
+
+using namespace std;
+
+// Picks the Lagrange multiplier for a tree prepared with
+// QuadTree::prepareRateDistortion. Every probe is one linear pruning pass
+// over the cached block statistics; byte targets additionally run the .qtc
+// coder on the pruned tree so the size being matched is the real one.
+namespace RateDistortion
+{
+    enum TargetKind
+    {
+        TargetLambda,   // prune with the given lambda as is
+        TargetBytes,    // largest tree whose .qtc file fits in the given size
+        TargetPSNR      // smallest tree reaching the given PSNR in dB
+    };
+
+    struct Target
+    {
+        TargetKind kind = TargetLambda;
+        double value = 0.0;
+    };
+
+    struct Result
+    {
+        double lambda = 0.0;
+        RDCost cost;
+        size_t bytes = 0;
+        double psnr = 0.0;
+        int probes = 0;
+    };
+
+    // Leaves the tree pruned for the chosen lambda. Returns false when the
+    // target cannot be met; the tree then holds the closest attempt.
+    bool fit(QuadTree& tree, const Target& target, Result& result);
+
+    // PSNR of a pruning outcome against the source the tree was prepared from
+    double psnr(const QuadTree& tree, double distortion);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+#include <string>
+#include <vector>
+#include "quadtree.hpp"
+
+using namespace std;
+
+namespace Sequence
+{
+    bool readFrameList(const string& listPath, vector<string>& frames);
+
+    // Compresses frames in order, reusing the previous frame's tree, into
+    // frame_NNNNN.qtd files (LeafCoder::encodeFrame). Keyframes (the first
+    // frame, every keyframeInterval frames, or a size or format change) hold
+    // the whole tree; other frames only the subtrees that were rebuilt.
+    int runSequence(const vector<string>& frames, const string& outputDir, ErrorMethod method,
+                    float threshold, int minSize, SplitMode splitMode, int keyframeInterval);
+
+    // main.exe --sequence <daftar_frame.txt> <folder_output> <metode> <threshold> <ukuran_blok_min> [interval_keyframe]
+    int sequenceHandler(int argc, char* argv[]);
+
+    // Plays the .qtd frames of a folder back in order and writes each as
+    // frame_NNNNN.png; main.exe --decode <folder_sequence> <folder_output>
+    int decodeSequence(const string& inputDir, const string& outputDir);
+}
+
+#endif
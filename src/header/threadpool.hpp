@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using namespace std;
+
+// Fixed set of worker threads shared by the loader, reconstruction and the
+// daemon. parallelFor splits [begin, end) into chunks; the calling thread
+// works on chunks too, so nested calls from inside a worker cannot deadlock.
+class ThreadPool
+{
+    private:
+        vector<thread> workers;
+        deque<function<void()>> tasks;
+        mutex queueMutex;
+        condition_variable queueReady;
+        bool stopping;
+
+        void workerLoop();
+
+    public:
+        explicit ThreadPool(unsigned threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        unsigned getThreadCount() const noexcept;
+        void parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body);
+
+        static ThreadPool& shared();
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef THRESHOLDSEARCH_HPP
+#define THRESHOLDSEARCH_HPP
+
+#include "quadtree.hpp"
+
+using namespace std;
+
+// Finds the threshold for a quality target on a tree prepared with
+// QuadTree::prepareThresholdSearch. The tree only changes where the
+// threshold crosses a cached block error, so the search bisects over those
+// errors; each probe is one estimateQuality pass and no image is rescanned.
+namespace ThresholdSearch
+{
+    enum Metric
+    {
+        TargetPSNR,
+        TargetSSIM
+    };
+
+    struct Result
+    {
+        float threshold = 0.0f;
+        QualityStats quality;
+        int probes = 0;
+    };
+
+    // Prunes the tree to the largest threshold whose estimated quality still
+    // reaches target. Returns false when even the full tree falls short; the
+    // tree is then left fully split.
+    bool fit(QuadTree& tree, Metric metric, double target, Result& result);
+}
+
+#endif
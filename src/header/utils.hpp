@@ -3,31 +3,25 @@
 
 #include <string>
 #include <vector>
-#include <chrono>
 #include "quadtree.hpp"
 
 using namespace std;
 
 bool fileExists(const string& filename);
 bool hasValidExtension(const string& filename);
+bool hasExtension(const string& path, const string& ext);
 bool isValidErrorMethod(const string& errorMethodStr);
-ErrorMethod parseErrorMethod(const string& errorMethodStr);
+bool parseErrorMethod(const string& errorMethodStr, ErrorMethod& method);
 bool isValidThreshold(ErrorMethod method, float threshold);
 
 string trim(const string& s);
-string getNonEmptyLine(const string& prompt);
 
-bool processImage(const string& imagePath, vector<vector<RGB>>& image);
+bool loadImage(const string& imagePath, vector<vector<RGB>>& image, ImageFormat& format);
+bool loadImageFromMemory(const unsigned char* bytes, size_t size, vector<vector<RGB>>& image, ImageFormat& format);
 
 long long getFileSize(const string& path);
 
-void inputHandler(string& inputImagePath, vector<vector<RGB>>& image,
-                  string& errorMethodStr, ErrorMethod& method, float& threshold,
-                  int& minBlockSize, string& outputImagePath);
-
-void saveCompressedImage(const vector<vector<RGB>>& image, const string& outputImagePath);
-
-void outputHandler(const string &outputImagePath, const string &inputImagePath,
-                   int maxDepth, int nodeCount, chrono::milliseconds duration);
+// Writes without any console output; false if the image is empty or the write failed
+bool writeImage(const vector<vector<RGB>>& image, const string& outputImagePath, const ImageFormat& format = ImageFormat());
 
 #endif // UTILS_HPP
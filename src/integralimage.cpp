@@ -0,0 +1,375 @@
+#include "header/integralimage.hpp"
+#include "header/cpudispatch.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+    vector<float> makeLinearLUT(int sampleMax)
+    {
+        vector<float> t(static_cast<size_t>(sampleMax) + 1);
+        for (int i = 0; i <= sampleMax; ++i)
+        {
+            float c = static_cast<float>(i) / sampleMax;
+            t[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }
+
+    // sRGB 8-bit / 16-bit -> linear [0, 1], computed once per depth
+    const vector<float>& srgbToLinearLUT(int sampleMax)
+    {
+        static const vector<float> lut8 = makeLinearLUT(255);
+        if (sampleMax == 255)
+        {
+            return lut8;
+        }
+        static const vector<float> lut16 = makeLinearLUT(65535);
+        return lut16;
+    }
+
+    float labF(float t)
+    {
+        const float delta = 6.0f / 29.0f;
+        return (t > delta * delta * delta) ? cbrtf(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+    }
+
+    double tableSum(const vector<double>& table, size_t stride, int x, int y, int w, int h)
+    {
+        const size_t top = static_cast<size_t>(y) * stride;
+        const size_t bottom = static_cast<size_t>(y + h) * stride;
+        return table[bottom + x + w] - table[top + x + w] - table[bottom + x] + table[top + x];
+    }
+
+    // Converts n pixels of one image row into three planar float rows, and
+    // alpha into c3 when it is given. The rows are kept separate (SoA) so the
+    // per-channel arithmetic loops vectorize.
+    QT_MULTIVERSION void convertRow(const RGB* src, int n, ColorSpace space, const ImageFormat& format, float* c0, float* c1, float* c2, float* c3)
+    {
+        if (c3 != nullptr)
+        {
+            // Lab axes span about 0..100, so alpha is brought to the same scale there
+            const float alphaScale = (space == CIELab) ? 100.0f / format.sampleMax : 1.0f;
+            for (int j = 0; j < n; ++j)
+            {
+                c3[j] = src[j].a * alphaScale;
+            }
+        }
+
+        if (space == SRGB)
+        {
+            for (int j = 0; j < n; ++j)
+            {
+                c0[j] = static_cast<float>(src[j].r);
+                c1[j] = static_cast<float>(src[j].g);
+                c2[j] = static_cast<float>(src[j].b);
+            }
+            return;
+        }
+
+        if (space == YCbCr)
+        {
+            // BT.601 full range, same 0..sampleMax scale as the RGB input
+            const float offset = (format.sampleMax + 1) / 2.0f;
+            for (int j = 0; j < n; ++j)
+            {
+                c0[j] = static_cast<float>(src[j].r);
+                c1[j] = static_cast<float>(src[j].g);
+                c2[j] = static_cast<float>(src[j].b);
+            }
+            for (int j = 0; j < n; ++j)
+            {
+                float r = c0[j], g = c1[j], b = c2[j];
+                c0[j] =  0.299f    * r + 0.587f    * g + 0.114f    * b;
+                c1[j] = -0.168736f * r - 0.331264f * g + 0.5f      * b + offset;
+                c2[j] =  0.5f      * r - 0.418688f * g - 0.081312f * b + offset;
+            }
+            return;
+        }
+
+        // CIELAB (D65): LUT gamma, then linear RGB -> XYZ -> Lab. HDR samples are already linear.
+        if (format.hdrScale > 0.0f)
+        {
+            const float inv = 1.0f / format.sampleMax;
+            for (int j = 0; j < n; ++j)
+            {
+                c0[j] = src[j].r * inv;
+                c1[j] = src[j].g * inv;
+                c2[j] = src[j].b * inv;
+            }
+        }
+        else
+        {
+            const vector<float>& lut = srgbToLinearLUT(format.sampleMax);
+            const int mask = format.sampleMax;
+            for (int j = 0; j < n; ++j)
+            {
+                c0[j] = lut[src[j].r & mask];
+                c1[j] = lut[src[j].g & mask];
+                c2[j] = lut[src[j].b & mask];
+            }
+        }
+        for (int j = 0; j < n; ++j)
+        {
+            float r = c0[j], g = c1[j], b = c2[j];
+            c0[j] = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / 0.95047f;
+            c1[j] =  0.2126729f * r + 0.7151522f * g + 0.0721750f * b;
+            c2[j] = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / 1.08883f;
+        }
+        for (int j = 0; j < n; ++j)
+        {
+            float fx = labF(c0[j]), fy = labF(c1[j]), fz = labF(c2[j]);
+            c0[j] = 116.0f * fy - 16.0f;
+            c1[j] = 500.0f * (fx - fy);
+            c2[j] = 200.0f * (fy - fz);
+        }
+    }
+}
+
+double BlockMoments::getMean(int channel) const noexcept
+{
+    return count > 0 ? sum[channel] / count : 0.0;
+}
+
+double BlockMoments::getVariance(int channel) const noexcept
+{
+    if (count <= 0)
+    {
+        return 0.0;
+    }
+    double mean = sum[channel] / count;
+    return max(0.0, sumSq[channel] / count - mean * mean);
+}
+
+bool BlockMoments::hasAlpha() const noexcept
+{
+    return channels == 2 || channels == 4;
+}
+
+BlockMoments& BlockMoments::operator+=(const BlockMoments& other) noexcept
+{
+    // Both sides describe the same image
+    channels = other.channels;
+    count += other.count;
+    for (int c = 0; c < 4; ++c)
+    {
+        sum[c] += other.sum[c];
+        sumSq[c] += other.sumSq[c];
+    }
+    return *this;
+}
+
+IntegralImage::IntegralImage() : space(SRGB), format(), width(0), height(0), stride(0), planes(3), patchedArea(0) {}
+
+void IntegralImage::build(const vector<vector<RGB>>& image, ColorSpace space, const ImageFormat& format)
+{
+    this->space = space;
+    this->format = format;
+    patches.clear();
+    patchedArea = 0;
+    height = static_cast<int>(image.size());
+    width = height > 0 ? static_cast<int>(image[0].size()) : 0;
+    stride = static_cast<size_t>(width) + 1;
+    planes = (format.channels == 2 || format.channels == 4) ? 4 : 3;
+
+    const size_t tableSize = stride * (static_cast<size_t>(height) + 1);
+    for (int c = 0; c < 4; ++c)
+    {
+        if (c < planes)
+        {
+            sum[c].assign(tableSize, 0.0);
+            sumSq[c].assign(tableSize, 0.0);
+        }
+        else
+        {
+            sum[c].clear();
+            sumSq[c].clear();
+        }
+    }
+
+    vector<float> rowBuffer(static_cast<size_t>(width) * planes);
+    array<float*, 4> plane = { rowBuffer.data(), rowBuffer.data() + width, rowBuffer.data() + 2 * width,
+                               planes == 4 ? rowBuffer.data() + 3 * width : nullptr };
+
+    for (int i = 0; i < height; ++i)
+    {
+        convertRow(image[i].data(), width, space, format, plane[0], plane[1], plane[2], plane[3]);
+
+        for (int c = 0; c < planes; ++c)
+        {
+            const double* prevS = &sum[c][i * stride];
+            const double* prevQ = &sumSq[c][i * stride];
+            double* curS = &sum[c][(i + 1) * stride];
+            double* curQ = &sumSq[c][(i + 1) * stride];
+            double rowS = 0.0, rowQ = 0.0;
+
+            for (int j = 0; j < width; ++j)
+            {
+                double v = plane[c][j];
+                rowS += v;
+                rowQ += v * v;
+                curS[j + 1] = prevS[j + 1] + rowS;
+                curQ[j + 1] = prevQ[j + 1] + rowQ;
+            }
+        }
+    }
+}
+
+void IntegralImage::update(const vector<vector<RGB>>& image, const Rect& dirty)
+{
+    const int x0 = max(0, dirty.x), y0 = max(0, dirty.y);
+    const int x1 = min(width, dirty.x + dirty.width), y1 = min(height, dirty.y + dirty.height);
+    if (empty() || x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    // Every query pays for each patch, so fold them back once they pile up
+    const int w = x1 - x0, h = y1 - y0;
+    if (patches.size() >= 8 || (patchedArea + 1LL * w * h) * 8 > 1LL * width * height)
+    {
+        build(image, space, format);
+        return;
+    }
+
+    Patch patch;
+    patch.area = {x0, y0, w, h};
+    patch.stride = static_cast<size_t>(w) + 1;
+    for (int c = 0; c < planes; ++c)
+    {
+        patch.sum[c].assign(patch.stride * (h + 1), 0.0);
+        patch.sumSq[c].assign(patch.stride * (h + 1), 0.0);
+    }
+
+    // Delta between the new pixels and what the tables currently hold for them
+    vector<float> rowBuffer(static_cast<size_t>(w) * planes);
+    array<float*, 4> plane = { rowBuffer.data(), rowBuffer.data() + w, rowBuffer.data() + 2 * w,
+                               planes == 4 ? rowBuffer.data() + 3 * w : nullptr };
+    for (int i = 0; i < h; ++i)
+    {
+        convertRow(&image[y0 + i][x0], w, space, format, plane[0], plane[1], plane[2], plane[3]);
+
+        for (int c = 0; c < planes; ++c)
+        {
+            const double* prevS = &patch.sum[c][i * patch.stride];
+            const double* prevQ = &patch.sumSq[c][i * patch.stride];
+            double* curS = &patch.sum[c][(i + 1) * patch.stride];
+            double* curQ = &patch.sumSq[c][(i + 1) * patch.stride];
+            double rowS = 0.0, rowQ = 0.0;
+
+            for (int j = 0; j < w; ++j)
+            {
+                double v = plane[c][j];
+                rowS += v - getSum(c, x0 + j, y0 + i, 1, 1);
+                rowQ += v * v - getSumSq(c, x0 + j, y0 + i, 1, 1);
+                curS[j + 1] = prevS[j + 1] + rowS;
+                curQ[j + 1] = prevQ[j + 1] + rowQ;
+            }
+        }
+    }
+
+    patches.push_back(move(patch));
+    patchedArea += 1LL * w * h;
+}
+
+void IntegralImage::clear() noexcept
+{
+    width = height = 0;
+    stride = 0;
+    patches.clear();
+    patchedArea = 0;
+    // Keep the capacity: the next build over a same-sized image allocates nothing
+    for (int c = 0; c < 4; ++c)
+    {
+        sum[c].clear();
+        sumSq[c].clear();
+    }
+}
+
+bool IntegralImage::hasAlpha() const noexcept
+{
+    return planes == 4;
+}
+
+bool IntegralImage::empty() const noexcept
+{
+    return sum[0].empty();
+}
+
+ColorSpace IntegralImage::getColorSpace() const noexcept
+{
+    return space;
+}
+
+int IntegralImage::getWidth() const noexcept
+{
+    return width;
+}
+
+int IntegralImage::getHeight() const noexcept
+{
+    return height;
+}
+
+double IntegralImage::rectSum(const vector<double>& table, int x, int y, int w, int h) const noexcept
+{
+    return tableSum(table, stride, x, y, w, h);
+}
+
+double IntegralImage::patchSum(bool squares, int channel, int x, int y, int w, int h) const noexcept
+{
+    double total = 0.0;
+    for (const Patch& p : patches)
+    {
+        const int x0 = max(x, p.area.x), y0 = max(y, p.area.y);
+        const int x1 = min(x + w, p.area.x + p.area.width), y1 = min(y + h, p.area.y + p.area.height);
+        if (x0 < x1 && y0 < y1)
+        {
+            const vector<double>& table = squares ? p.sumSq[channel] : p.sum[channel];
+            total += tableSum(table, p.stride, x0 - p.area.x, y0 - p.area.y, x1 - x0, y1 - y0);
+        }
+    }
+    return total;
+}
+
+double IntegralImage::getSum(int channel, int x, int y, int w, int h) const noexcept
+{
+    double s = rectSum(sum[channel], x, y, w, h);
+    return patches.empty() ? s : s + patchSum(false, channel, x, y, w, h);
+}
+
+double IntegralImage::getSumSq(int channel, int x, int y, int w, int h) const noexcept
+{
+    double s = rectSum(sumSq[channel], x, y, w, h);
+    return patches.empty() ? s : s + patchSum(true, channel, x, y, w, h);
+}
+
+double IntegralImage::getMean(int channel, int x, int y, int w, int h) const noexcept
+{
+    double n = static_cast<double>(w) * h;
+    return n > 0 ? getSum(channel, x, y, w, h) / n : 0.0;
+}
+
+double IntegralImage::getVariance(int channel, int x, int y, int w, int h) const noexcept
+{
+    double n = static_cast<double>(w) * h;
+    if (n <= 0)
+    {
+        return 0.0;
+    }
+    double mean = getSum(channel, x, y, w, h) / n;
+    return max(0.0, getSumSq(channel, x, y, w, h) / n - mean * mean);
+}
+
+BlockMoments IntegralImage::getMoments(int x, int y, int w, int h) const noexcept
+{
+    BlockMoments m;
+    m.count = static_cast<double>(w) * h;
+    m.channels = format.channels;
+    for (int c = 0; c < planes; ++c)
+    {
+        m.sum[c] = getSum(c, x, y, w, h);
+        m.sumSq[c] = getSumSq(c, x, y, w, h);
+    }
+    return m;
+}
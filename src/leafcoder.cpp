@@ -0,0 +1,799 @@
+#include "header/leafcoder.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+
+namespace
+{
+    const char MAGIC[4] = {'Q', 'T', 'C', '1'};
+    const int HEADER_SIZE = 4 + 4 + 4 + 1 + 1 + 4 + 4;
+    // QTC2 adds a flags byte after the QTC1 header; QTC1 is still written
+    // when no flag is set
+    const char MAGIC_FLAGS[4] = {'Q', 'T', 'C', '2'};
+    const uint8_t FLAG_REGIONS = 1;
+    // Sequence frames: the QTC2 header, then a change map over the quad
+    // partition leading to each subtree that is coded
+    const char MAGIC_FRAME[4] = {'Q', 'T', 'D', '1'};
+    const uint8_t FLAG_KEYFRAME = 1;
+
+    // LZMA-style binary range coder: 11-bit probabilities adapting by 1/32
+    const int PROB_BITS = 11;
+    const uint16_t PROB_INIT = 1 << (PROB_BITS - 1);
+    const int PROB_SHIFT = 5;
+    const uint32_t RANGE_TOP = 1u << 24;
+
+    const int DEPTH_CONTEXTS = 16;
+    const int ACTIVITY_CONTEXTS = 3;
+    const int MAX_EXPONENT = 18;
+    const int JOIN_CONTEXTS = 4;
+    const int PICK_CONTEXTS = 8;
+
+    class RangeEncoder
+    {
+        private:
+            vector<uint8_t>& out;
+            uint64_t low = 0;
+            uint32_t range = 0xFFFFFFFFu;
+            uint8_t cache = 0;
+            uint64_t cacheSize = 1;
+
+            void shiftLow()
+            {
+                if (static_cast<uint32_t>(low) < 0xFF000000u || (low >> 32) != 0)
+                {
+                    uint8_t carry = static_cast<uint8_t>(low >> 32);
+                    uint8_t pending = cache;
+                    do
+                    {
+                        out.push_back(static_cast<uint8_t>(pending + carry));
+                        pending = 0xFF;
+                    } while (--cacheSize != 0);
+                    cache = static_cast<uint8_t>(low >> 24);
+                }
+                ++cacheSize;
+                low = (low & 0x00FFFFFFu) << 8;
+            }
+
+        public:
+            explicit RangeEncoder(vector<uint8_t>& out) : out(out) {}
+
+            int bit(uint16_t& prob, int value)
+            {
+                uint32_t bound = (range >> PROB_BITS) * prob;
+                if (value == 0)
+                {
+                    range = bound;
+                    prob += ((1 << PROB_BITS) - prob) >> PROB_SHIFT;
+                }
+                else
+                {
+                    low += bound;
+                    range -= bound;
+                    prob -= prob >> PROB_SHIFT;
+                }
+                while (range < RANGE_TOP)
+                {
+                    range <<= 8;
+                    shiftLow();
+                }
+                return value;
+            }
+
+            uint32_t direct(uint32_t value, int bits)
+            {
+                for (int i = bits - 1; i >= 0; --i)
+                {
+                    range >>= 1;
+                    if ((value >> i) & 1)
+                    {
+                        low += range;
+                    }
+                    while (range < RANGE_TOP)
+                    {
+                        range <<= 8;
+                        shiftLow();
+                    }
+                }
+                return value;
+            }
+
+            void flush()
+            {
+                for (int i = 0; i < 5; ++i)
+                {
+                    shiftLow();
+                }
+            }
+    };
+
+    // Mirrors RangeEncoder: the value arguments are ignored and the decoded
+    // value is returned, so one traversal routine serves both directions.
+    class RangeDecoder
+    {
+        private:
+            const uint8_t* cur;
+            const uint8_t* end;
+            uint32_t range = 0xFFFFFFFFu;
+            uint32_t code = 0;
+            size_t overrun = 0;
+
+            uint8_t next()
+            {
+                if (cur < end)
+                {
+                    return *cur++;
+                }
+                ++overrun;
+                return 0;
+            }
+
+        public:
+            RangeDecoder(const uint8_t* begin, const uint8_t* end) : cur(begin), end(end)
+            {
+                for (int i = 0; i < 5; ++i)
+                {
+                    code = (code << 8) | next();
+                }
+            }
+
+            int bit(uint16_t& prob, int)
+            {
+                uint32_t bound = (range >> PROB_BITS) * prob;
+                int value;
+                if (code < bound)
+                {
+                    range = bound;
+                    prob += ((1 << PROB_BITS) - prob) >> PROB_SHIFT;
+                    value = 0;
+                }
+                else
+                {
+                    code -= bound;
+                    range -= bound;
+                    prob -= prob >> PROB_SHIFT;
+                    value = 1;
+                }
+                while (range < RANGE_TOP)
+                {
+                    range <<= 8;
+                    code = (code << 8) | next();
+                }
+                return value;
+            }
+
+            uint32_t direct(uint32_t, int bits)
+            {
+                uint32_t value = 0;
+                for (int i = 0; i < bits; ++i)
+                {
+                    range >>= 1;
+                    uint32_t one = (code >= range) ? 1u : 0u;
+                    code -= range & (0u - one);
+                    value = (value << 1) | one;
+                    while (range < RANGE_TOP)
+                    {
+                        range <<= 8;
+                        code = (code << 8) | next();
+                    }
+                }
+                return value;
+            }
+
+            // The decoder reads exactly the bytes the encoder wrote, flush
+            // included, so any read past the end means the data was cut short
+            bool truncated() const
+            {
+                return overrun > 0;
+            }
+    };
+
+    // Adaptive probabilities. Residual contexts are (plane, neighbor activity);
+    // planes are r (or gray), g - r, b - r and alpha.
+    struct Model
+    {
+        uint16_t split[DEPTH_CONTEXTS];
+        uint16_t vertical[DEPTH_CONTEXTS];
+        uint16_t zero[4][ACTIVITY_CONTEXTS];
+        uint16_t sign[4][ACTIVITY_CONTEXTS];
+        uint16_t exponent[4][ACTIVITY_CONTEXTS][MAX_EXPONENT];
+        uint16_t mantissa[4][ACTIVITY_CONTEXTS][MAX_EXPONENT];
+        uint16_t join[JOIN_CONTEXTS];
+        uint16_t pick[PICK_CONTEXTS];
+        uint16_t touched[DEPTH_CONTEXTS];
+        uint16_t here[DEPTH_CONTEXTS];
+
+        Model()
+        {
+            fill_n(&touched[0], DEPTH_CONTEXTS, PROB_INIT);
+            fill_n(&here[0], DEPTH_CONTEXTS, PROB_INIT);
+            fill_n(&join[0], JOIN_CONTEXTS, PROB_INIT);
+            fill_n(&pick[0], PICK_CONTEXTS, PROB_INIT);
+            fill_n(&split[0], DEPTH_CONTEXTS, PROB_INIT);
+            fill_n(&vertical[0], DEPTH_CONTEXTS, PROB_INIT);
+            fill_n(&zero[0][0], 4 * ACTIVITY_CONTEXTS, PROB_INIT);
+            fill_n(&sign[0][0], 4 * ACTIVITY_CONTEXTS, PROB_INIT);
+            fill_n(&exponent[0][0][0], 4 * ACTIVITY_CONTEXTS * MAX_EXPONENT, PROB_INIT);
+            fill_n(&mantissa[0][0][0], 4 * ACTIVITY_CONTEXTS * MAX_EXPONENT, PROB_INIT);
+        }
+    };
+
+    int bitLength(uint32_t v)
+    {
+        int n = 0;
+        while (v != 0)
+        {
+            ++n;
+            v >>= 1;
+        }
+        return n;
+    }
+
+    // Median edge detector (LOCO-I) on the component values around a leaf
+    int predict(int left, int top, int topLeft)
+    {
+        if (topLeft >= max(left, top))
+        {
+            return min(left, top);
+        }
+        if (topLeft <= min(left, top))
+        {
+            return max(left, top);
+        }
+        return left + top - topLeft;
+    }
+
+    template <class Coder>
+    class TreeCodec
+    {
+        private:
+            Coder& rc;
+            Model model;
+            vector<vector<RGB>>& canvas;
+            const ImageFormat format;
+            const SplitMode splitMode;
+            const int activityShift;
+
+            // Merged regions: the decoded region of every pixel and the color
+            // of every decoded region. The encoder also maps the tree's region
+            // ids to decoded ones, walking its leaves in collectLeaves order.
+            const bool regions;
+            const vector<int>* leafRegions;
+            size_t leafIndex = 0;
+            vector<vector<int>> regionCanvas;
+            vector<RGB> regionColors;
+            vector<int> decodedRegion;
+            vector<int> candidates;
+
+            // Zero flag, sign, unary exponent, then one modeled and k-1 raw mantissa bits
+            int residual(int plane, int ctx, int value)
+            {
+                if (rc.bit(model.zero[plane][ctx], value == 0))
+                {
+                    return 0;
+                }
+                int negative = rc.bit(model.sign[plane][ctx], value < 0);
+                uint32_t magnitude = static_cast<uint32_t>(abs(value));
+                int k = bitLength(magnitude) - 1;
+
+                int exponent = 0;
+                while (exponent < MAX_EXPONENT - 1 && rc.bit(model.exponent[plane][ctx][exponent], exponent < k))
+                {
+                    ++exponent;
+                }
+
+                uint32_t decoded = 1;
+                if (exponent >= 1)
+                {
+                    uint32_t top = rc.bit(model.mantissa[plane][ctx][exponent], (magnitude >> (exponent - 1)) & 1);
+                    uint32_t rest = rc.direct(magnitude & ((1u << (exponent - 1)) - 1), exponent - 1);
+                    decoded = (((decoded << 1) | top) << (exponent - 1)) | rest;
+                }
+                return negative ? -static_cast<int>(decoded) : static_cast<int>(decoded);
+            }
+
+            int activity(int left, int top, int topLeft) const
+            {
+                int grad = (abs(left - topLeft) + abs(top - topLeft)) >> activityShift;
+                return (grad == 0) ? 0 : (grad <= 16 ? 1 : 2);
+            }
+
+            // The color the decoder will reconstruct; the encoder predicts from the same values
+            RGB canonical(RGB c) const
+            {
+                if (format.channels <= 2)
+                {
+                    c.g = c.b = c.r;
+                }
+                if (format.channels != 2 && format.channels != 4)
+                {
+                    c.a = format.sampleMax;
+                }
+                return c;
+            }
+
+            RGB leafColor(const Rect& r, RGB color)
+            {
+                // Neighbors in the middle of the left column and top row are always decoded before this leaf
+                const bool hasLeft = r.x > 0, hasTop = r.y > 0;
+                const int mid = (format.sampleMax + 1) / 2;
+                RGB left{mid, mid, mid, format.sampleMax}, top = left, topLeft = left;
+                if (hasLeft)
+                {
+                    left = canvas[r.y + r.height / 2][r.x - 1];
+                }
+                if (hasTop)
+                {
+                    top = canvas[r.y - 1][r.x + r.width / 2];
+                }
+                if (hasLeft && hasTop)
+                {
+                    topLeft = canvas[r.y - 1][r.x - 1];
+                }
+                else
+                {
+                    if (!hasLeft) left = top;
+                    if (!hasTop) top = left;
+                    topLeft = left;
+                }
+
+                const int L[4] = { left.r, left.g, left.b, left.a };
+                const int T[4] = { top.r, top.g, top.b, top.a };
+                const int TL[4] = { topLeft.r, topLeft.g, topLeft.b, topLeft.a };
+                const int C[4] = { color.r, color.g, color.b, color.a };
+                int out[4] = { 0, 0, 0, format.sampleMax };
+                const int components = (format.channels >= 3) ? 3 : 1;
+
+                int baseResidual = 0;
+                for (int k = 0; k < components; ++k)
+                {
+                    int pred = predict(L[k], T[k], TL[k]);
+                    int ctx = activity(L[k], T[k], TL[k]);
+                    // g and b residuals are coded relative to the r residual
+                    int v = residual(k, ctx, (C[k] - pred) - baseResidual) + baseResidual;
+                    if (k == 0)
+                    {
+                        baseResidual = v;
+                    }
+                    out[k] = min(max(pred + v, 0), format.sampleMax);
+                }
+                if (format.channels == 2 || format.channels == 4)
+                {
+                    int pred = predict(L[3], T[3], TL[3]);
+                    int v = residual(3, activity(L[3], T[3], TL[3]), C[3] - pred);
+                    out[3] = min(max(pred + v, 0), format.sampleMax);
+                }
+
+                return canonical(RGB{out[0], out[components == 3 ? 1 : 0], out[components == 3 ? 2 : 0], out[3]});
+            }
+
+            // Regions already decoded along the left column and top row, in
+            // the order they are met
+            void gatherCandidates(const Rect& r)
+            {
+                candidates.clear();
+                auto add = [&](int region)
+                {
+                    if (find(candidates.begin(), candidates.end(), region) == candidates.end())
+                    {
+                        candidates.push_back(region);
+                    }
+                };
+                for (int y = r.y, last = -1; r.x > 0 && y < r.y + r.height; ++y)
+                {
+                    if (regionCanvas[y][r.x - 1] != last)
+                    {
+                        last = regionCanvas[y][r.x - 1];
+                        add(last);
+                    }
+                }
+                for (int x = r.x, last = -1; r.y > 0 && x < r.x + r.width; ++x)
+                {
+                    if (regionCanvas[r.y - 1][x] != last)
+                    {
+                        last = regionCanvas[r.y - 1][x];
+                        add(last);
+                    }
+                }
+            }
+
+            // A leaf either joins a neighboring region, coded as its place in
+            // the candidate list, or opens a new one and codes its color
+            RGB regionLeaf(const Rect& r, const QuadTreeNode* src)
+            {
+                gatherCandidates(r);
+                const int source = src ? (*leafRegions)[leafIndex++] : -1;
+                int target = -1;
+                if (src && decodedRegion[source] >= 0)
+                {
+                    auto it = find(candidates.begin(), candidates.end(), decodedRegion[source]);
+                    target = (it == candidates.end()) ? -1 : static_cast<int>(it - candidates.begin());
+                }
+
+                const int count = static_cast<int>(candidates.size());
+                int region;
+                if (count > 0 && rc.bit(model.join[min(count, JOIN_CONTEXTS) - 1], target >= 0))
+                {
+                    int k = 0;
+                    while (k + 1 < count && rc.bit(model.pick[min(k, PICK_CONTEXTS - 1)], k < target))
+                    {
+                        ++k;
+                    }
+                    region = candidates[k];
+                }
+                else
+                {
+                    // A region met again out of reach of its earlier leaves is
+                    // coded twice rather than given a longer reference
+                    region = static_cast<int>(regionColors.size());
+                    regionColors.push_back(leafColor(r, canonical(src ? src->getAvgColor() : RGB{0, 0, 0, 0})));
+                    if (src)
+                    {
+                        decodedRegion[source] = region;
+                    }
+                }
+
+                for (int i = r.y; i < r.y + r.height; ++i)
+                {
+                    fill(regionCanvas[i].begin() + r.x, regionCanvas[i].begin() + r.x + r.width, region);
+                }
+                return regionColors[region];
+            }
+
+        public:
+            // leafRegions is the tree's region list when encoding one, or
+            // nullptr while decoding; regions says whether the stream has them
+            TreeCodec(Coder& rc, vector<vector<RGB>>& canvas, const ImageFormat& format, SplitMode splitMode,
+                      bool regions = false, const vector<int>* leafRegions = nullptr, int regionCount = 0)
+                : rc(rc), canvas(canvas), format(format), splitMode(splitMode),
+                  activityShift(format.sampleMax > 255 ? 8 : 0), regions(regions), leafRegions(leafRegions)
+            {
+                if (regions)
+                {
+                    regionCanvas.assign(canvas.size(), vector<int>(canvas.empty() ? 0 : canvas[0].size(), -1));
+                    decodedRegion.assign(regionCount, -1);
+                }
+            }
+
+            // src is the tree being encoded, or nullptr while decoding
+            void node(const QuadTreeNode* src, const Rect& r, int depth)
+            {
+                const int ctx = min(depth, DEPTH_CONTEXTS - 1);
+                const bool splittable = (splitMode == QuadSplit) ? (r.width >= 2 && r.height >= 2) : (r.width >= 2 || r.height >= 2);
+                const bool split = splittable && rc.bit(model.split[ctx], src && !src->isLeafNode());
+
+                if (!split)
+                {
+                    RGB color = regions ? regionLeaf(r, src) : leafColor(r, canonical(src ? src->getAvgColor() : RGB{0, 0, 0, 0}));
+                    for (int i = r.y; i < r.y + r.height; ++i)
+                    {
+                        fill(canvas[i].begin() + r.x, canvas[i].begin() + r.x + r.width, color);
+                    }
+                    return;
+                }
+
+                if (splitMode == QuadSplit)
+                {
+                    const int midW = r.width / 2, midH = r.height / 2;
+                    const Rect quads[4] = {
+                        {r.x, r.y, midW, midH},
+                        {r.x + midW, r.y, r.width - midW, midH},
+                        {r.x, r.y + midH, midW, r.height - midH},
+                        {r.x + midW, r.y + midH, r.width - midW, r.height - midH},
+                    };
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        node(src ? src->getChild(i) : nullptr, quads[i], depth + 1);
+                    }
+                    return;
+                }
+
+                // Adaptive: orientation (only when both are possible), then the cut offset in raw bits
+                const QuadTreeNode* first = src ? src->getChild(0) : nullptr;
+                bool vertical = r.width >= 2;
+                if (r.width >= 2 && r.height >= 2)
+                {
+                    vertical = rc.bit(model.vertical[ctx], first && first->getBounds().width < r.width) != 0;
+                }
+                const int length = vertical ? r.width : r.height;
+                const int cut = first ? (vertical ? first->getBounds().width : first->getBounds().height) : 1;
+                int position = 1 + static_cast<int>(rc.direct(static_cast<uint32_t>(cut - 1), bitLength(static_cast<uint32_t>(length - 2))));
+                position = min(position, length - 1);
+
+                Rect a = r, b = r;
+                if (vertical)
+                {
+                    a.width = position;
+                    b.x += position;
+                    b.width -= position;
+                }
+                else
+                {
+                    a.height = position;
+                    b.y += position;
+                    b.height -= position;
+                }
+                node(first, a, depth + 1);
+                node(src ? src->getChild(1) : nullptr, b, depth + 1);
+            }
+
+            // Change map of a quad-split frame: whether block r holds any of
+            // the subtrees (given in leaf order when encoding, nullptr while
+            // decoding), and if so whether r is one, else its quadrants in turn
+            void changes(const vector<QuadTreeNode*>* subtrees, size_t& next, const Rect& r, int depth)
+            {
+                const int ctx = min(depth, DEPTH_CONTEXTS - 1);
+                const QuadTreeNode* src = (subtrees && next < subtrees->size()) ? (*subtrees)[next] : nullptr;
+                const Rect* s = src ? &src->getBounds() : nullptr;
+                const bool inside = s && s->x >= r.x && s->y >= r.y && s->x + s->width <= r.x + r.width && s->y + s->height <= r.y + r.height;
+                if (!rc.bit(model.touched[ctx], inside))
+                {
+                    return;
+                }
+                const bool splittable = r.width >= 2 && r.height >= 2;
+                const bool exact = inside && s->width == r.width && s->height == r.height;
+                if (!splittable || rc.bit(model.here[ctx], exact))
+                {
+                    node(src, r, depth);
+                    ++next;
+                    return;
+                }
+                const int midW = r.width / 2, midH = r.height / 2;
+                const Rect quads[4] = {
+                    {r.x, r.y, midW, midH},
+                    {r.x + midW, r.y, r.width - midW, midH},
+                    {r.x, r.y + midH, midW, r.height - midH},
+                    {r.x + midW, r.y + midH, r.width - midW, r.height - midH},
+                };
+                for (const Rect& q : quads)
+                {
+                    changes(subtrees, next, q, depth + 1);
+                }
+            }
+    };
+
+    void putU32(vector<uint8_t>& out, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    uint32_t getU32(const uint8_t* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    struct Header
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        ImageFormat format;
+        SplitMode splitMode = QuadSplit;
+        uint8_t flags = 0;
+    };
+
+    // Magic, size, channels, split mode, sample range, HDR scale, and the
+    // flags byte for the formats that have one
+    void putHeader(vector<uint8_t>& out, const char magic[4], int width, int height, const ImageFormat& format, SplitMode splitMode, bool withFlags, uint8_t flags)
+    {
+        uint32_t scaleBits;
+        memcpy(&scaleBits, &format.hdrScale, sizeof(scaleBits));
+        out.assign(magic, magic + 4);
+        putU32(out, static_cast<uint32_t>(width));
+        putU32(out, static_cast<uint32_t>(height));
+        out.push_back(static_cast<uint8_t>(format.channels));
+        out.push_back(static_cast<uint8_t>(splitMode));
+        putU32(out, static_cast<uint32_t>(format.sampleMax));
+        putU32(out, scaleBits);
+        if (withFlags)
+        {
+            out.push_back(flags);
+        }
+    }
+
+    // Returns the size of the header, or 0 when it is cut short or does not
+    // describe an image this coder writes; the magic is checked by the caller
+    size_t getHeader(const vector<uint8_t>& data, bool withFlags, uint8_t knownFlags, Header& header)
+    {
+        const size_t size = HEADER_SIZE + (withFlags ? 1 : 0);
+        if (data.size() < size)
+        {
+            return 0;
+        }
+        const uint8_t* p = data.data() + 4;
+        const uint32_t scaleBits = getU32(p + 14);
+        header.width = getU32(p);
+        header.height = getU32(p + 4);
+        header.format.channels = p[8];
+        header.format.sampleMax = static_cast<int>(getU32(p + 10));
+        memcpy(&header.format.hdrScale, &scaleBits, sizeof(scaleBits));
+        header.splitMode = static_cast<SplitMode>(p[9]);
+        header.flags = withFlags ? p[18] : 0;
+
+        if (header.width == 0 || header.height == 0 || header.width > (1u << 20) || header.height > (1u << 20)
+            || header.format.channels < 1 || header.format.channels > 4
+            || (p[9] != QuadSplit && p[9] != AdaptiveSplit)
+            || (header.format.sampleMax != 255 && header.format.sampleMax != 65535)
+            || (header.flags & ~knownFlags) != 0)
+        {
+            return 0;
+        }
+        return size;
+    }
+
+    bool fail(string* error, const string& message)
+    {
+        if (error != nullptr)
+        {
+            *error = message;
+        }
+        return false;
+    }
+}
+
+bool LeafCoder::encode(const QuadTree& tree, const string& path, string* error)
+{
+    vector<uint8_t> data;
+    if (!encode(tree, data, error))
+    {
+        return false;
+    }
+
+    ofstream file(path, ios::binary);
+    if (!file.write(reinterpret_cast<const char*>(data.data()), data.size()))
+    {
+        return fail(error, "gagal menulis file .qtc: " + path);
+    }
+    return true;
+}
+
+bool LeafCoder::encode(const QuadTree& tree, vector<uint8_t>& data, string* error)
+{
+    const QuadTreeNode* root = tree.getRoot();
+    if (root == nullptr)
+    {
+        return fail(error, "quadtree kosong, tidak ada yang dikodekan");
+    }
+
+    const Rect& bounds = root->getBounds();
+    const ImageFormat& format = tree.getFormat();
+    const bool regions = tree.getRegionCount() > 0;
+    const uint8_t flags = regions ? FLAG_REGIONS : 0;
+    putHeader(data, flags ? MAGIC_FLAGS : MAGIC, bounds.width, bounds.height, format, tree.getSplitMode(), flags != 0, flags);
+
+    // The encoder reconstructs alongside so it predicts from exactly what the decoder sees
+    vector<vector<RGB>> canvas(bounds.height, vector<RGB>(bounds.width));
+    RangeEncoder rc(data);
+    TreeCodec<RangeEncoder> codec(rc, canvas, format, tree.getSplitMode(), regions, &tree.getLeafRegions(), tree.getRegionCount());
+    codec.node(root, Rect{0, 0, bounds.width, bounds.height}, 0);
+    rc.flush();
+    return true;
+}
+
+bool LeafCoder::decode(const string& path, vector<vector<RGB>>& image, ImageFormat& format, string* error, long long maxPixels)
+{
+    ifstream file(path, ios::binary);
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    const bool flagged = data.size() >= 4 && memcmp(data.data(), MAGIC_FLAGS, 4) == 0;
+    if (data.size() < 4 || (!flagged && memcmp(data.data(), MAGIC, 4) != 0))
+    {
+        return fail(error, "bukan file .qtc yang valid: " + path);
+    }
+    Header header;
+    const size_t headerSize = getHeader(data, flagged, FLAG_REGIONS, header);
+    if (headerSize == 0)
+    {
+        return fail(error, "header .qtc rusak: " + path);
+    }
+    // A single flat leaf codes any size in a few bytes, so the payload
+    // cannot bound the image; the cap keeps a bogus header from allocating
+    if (1LL * header.width * header.height > maxPixels)
+    {
+        return fail(error, "ukuran gambar .qtc melebihi batas piksel: " + path);
+    }
+
+    try
+    {
+        format = header.format;
+        image.assign(header.height, vector<RGB>(header.width));
+        RangeDecoder rc(data.data() + headerSize, data.data() + data.size());
+        TreeCodec<RangeDecoder> codec(rc, image, format, header.splitMode, (header.flags & FLAG_REGIONS) != 0);
+        codec.node(nullptr, Rect{0, 0, static_cast<int>(header.width), static_cast<int>(header.height)}, 0);
+        if (rc.truncated())
+        {
+            image.clear();
+            return fail(error, "file .qtc terpotong atau rusak: " + path);
+        }
+    }
+    catch (const bad_alloc&)
+    {
+        image.clear();
+        return fail(error, "memori tidak cukup untuk mendekode: " + path);
+    }
+    return true;
+}
+
+bool LeafCoder::encodeFrame(const QuadTree& tree, const vector<QuadTreeNode*>& subtrees, bool keyframe,
+                            vector<vector<RGB>>& canvas, vector<uint8_t>& data, string* error)
+{
+    const QuadTreeNode* root = tree.getRoot();
+    if (root == nullptr)
+    {
+        return fail(error, "quadtree kosong, tidak ada yang dikodekan");
+    }
+    if (tree.getSplitMode() != QuadSplit)
+    {
+        return fail(error, "frame .qtd hanya untuk quadtree dengan quad split");
+    }
+    const Rect& bounds = root->getBounds();
+    if (keyframe)
+    {
+        canvas.assign(bounds.height, vector<RGB>(bounds.width));
+    }
+    else if (static_cast<int>(canvas.size()) != bounds.height || canvas.empty() || static_cast<int>(canvas[0].size()) != bounds.width)
+    {
+        return fail(error, "frame sebelumnya tidak cocok dengan ukuran quadtree");
+    }
+
+    putHeader(data, MAGIC_FRAME, bounds.width, bounds.height, tree.getFormat(), tree.getSplitMode(), true, keyframe ? FLAG_KEYFRAME : 0);
+
+    // The pixels around each subtree come from the previous frame
+    RangeEncoder rc(data);
+    TreeCodec<RangeEncoder> codec(rc, canvas, tree.getFormat(), QuadSplit);
+    size_t next = 0;
+    codec.changes(&subtrees, next, bounds, 0);
+    rc.flush();
+    return true;
+}
+
+bool LeafCoder::decodeFrame(const vector<uint8_t>& data, vector<vector<RGB>>& canvas, ImageFormat& format, string* error, long long maxPixels)
+{
+    Header header;
+    const size_t headerSize = (data.size() >= 4 && memcmp(data.data(), MAGIC_FRAME, 4) == 0)
+        ? getHeader(data, true, FLAG_KEYFRAME, header) : 0;
+    if (headerSize == 0 || header.splitMode != QuadSplit)
+    {
+        return fail(error, "bukan frame .qtd yang valid");
+    }
+    if (1LL * header.width * header.height > maxPixels)
+    {
+        return fail(error, "ukuran frame .qtd melebihi batas piksel");
+    }
+
+    const bool keyframe = (header.flags & FLAG_KEYFRAME) != 0;
+    if (!keyframe && (canvas.size() != header.height || canvas.empty() || canvas[0].size() != header.width
+                      || format.channels != header.format.channels || format.sampleMax != header.format.sampleMax))
+    {
+        return fail(error, "frame delta tidak cocok dengan frame sebelumnya");
+    }
+
+    try
+    {
+        if (keyframe)
+        {
+            format = header.format;
+            canvas.assign(header.height, vector<RGB>(header.width));
+        }
+        RangeDecoder rc(data.data() + headerSize, data.data() + data.size());
+        TreeCodec<RangeDecoder> codec(rc, canvas, format, QuadSplit);
+        size_t next = 0;
+        codec.changes(nullptr, next, Rect{0, 0, static_cast<int>(header.width), static_cast<int>(header.height)}, 0);
+        if (rc.truncated())
+        {
+            // The canvas is no longer the encoder's; later deltas cannot apply
+            canvas.clear();
+            return fail(error, "frame .qtd terpotong atau rusak");
+        }
+    }
+    catch (const bad_alloc&)
+    {
+        canvas.clear();
+        return fail(error, "memori tidak cukup untuk mendekode frame .qtd");
+    }
+    return true;
+}
@@ -0,0 +1,271 @@
+#include "header/leafmerge.hpp"
+#include "header/errormeasurement.hpp"
+#include "header/integralimage.hpp"
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include <unordered_map>
+#include <cmath>
+
+namespace
+{
+    struct Region
+    {
+        BlockMoments moments;
+        RGB minColor;
+        RGB maxColor;
+    };
+
+    struct Edge
+    {
+        int a, b;
+        int distance;
+    };
+
+    int findRoot(vector<int>& parent, int i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    float rawRegionError(const Region& region, ErrorMethod method, int sampleMax)
+    {
+        switch (method)
+        {
+        case Variance:
+            return ErrorMeasurement::computeVariance(region.moments);
+        case MAD:
+        {
+            // Mean absolute deviation never exceeds the standard deviation
+            float bound = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                bound += sqrtf(static_cast<float>(region.moments.getVariance(c)));
+            }
+            float alpha = region.moments.hasAlpha() ? sqrtf(static_cast<float>(region.moments.getVariance(3))) : 0.0f;
+            return ErrorMeasurement::withAlpha(region.moments.channels, bound / 3.0f, alpha);
+        }
+        case MaxPixelDiff:
+            return ErrorMeasurement::withAlpha(region.moments.channels,
+                                               ((region.maxColor.r - region.minColor.r) +
+                                                (region.maxColor.g - region.minColor.g) +
+                                                (region.maxColor.b - region.minColor.b)) / 3.0f,
+                                               static_cast<float>(region.maxColor.a - region.minColor.a));
+        case LumaVariance:
+            return ErrorMeasurement::computeLumaVariance(region.moments);
+        case DeltaE:
+            return ErrorMeasurement::computeDeltaE(region.moments);
+        case SSIM:
+            return ErrorMeasurement::computeSSIM(region.moments, sampleMax);
+        default:
+            return 0.0f;
+        }
+    }
+
+    float regionError(const Region& region, ErrorMethod method, int sampleMax)
+    {
+        return ErrorMeasurement::normalizeError(method, rawRegionError(region, method, sampleMax), sampleMax);
+    }
+
+    // Pairs up leaves whose facing edges lie on the same line and overlap.
+    // "before" ends at the line, "after" starts at it; both are sorted by start.
+    void sweepEdge(const vector<QuadTreeNode*>& leaves, vector<int>& before, vector<int>& after, bool vertical, vector<Edge>& edges)
+    {
+        auto start = [&](int i) { return vertical ? leaves[i]->getBounds().y : leaves[i]->getBounds().x; };
+        auto end = [&](int i) { const Rect& r = leaves[i]->getBounds(); return vertical ? r.y + r.height : r.x + r.width; };
+        auto byStart = [&](int l, int r) { return start(l) < start(r); };
+        sort(before.begin(), before.end(), byStart);
+        sort(after.begin(), after.end(), byStart);
+
+        size_t i = 0, j = 0;
+        while (i < before.size() && j < after.size())
+        {
+            int a = before[i], b = after[j];
+            RGB ca = leaves[a]->getAvgColor(), cb = leaves[b]->getAvgColor();
+            if (max(start(a), start(b)) < min(end(a), end(b)))
+            {
+                // Opaque images hold the same alpha everywhere, so it only counts where it varies
+                int distance = abs(ca.r - cb.r) + abs(ca.g - cb.g) + abs(ca.b - cb.b) + abs(ca.a - cb.a);
+                edges.push_back(Edge{a, b, distance});
+            }
+            if (end(a) < end(b)) ++i; else ++j;
+        }
+    }
+
+    // Walks the leaves in collectLeaves order, turning every subtree whose
+    // leaves all joined one region into a single leaf, and appends the region
+    // of each leaf that is left. Returns the subtree's region, or -1 when it
+    // holds several.
+    int collapseRegions(QuadTreeNode* node, const vector<int>& leafRegion, size_t& next, vector<int>& kept)
+    {
+        if (node->isLeafNode())
+        {
+            kept.push_back(leafRegion[next++]);
+            return kept.back();
+        }
+
+        const size_t first = kept.size();
+        int region = -2;
+        for (int i = 0; i < 4; ++i)
+        {
+            if (node->getChild(i) != nullptr)
+            {
+                int child = collapseRegions(node->getChild(i), leafRegion, next, kept);
+                region = (region == -2 || region == child) ? child : -1;
+            }
+        }
+        if (region >= 0)
+        {
+            // Every leaf below already carries the region color
+            node->setAvgColor(node->getChild(0)->getAvgColor());
+            node->clearChildren();
+            kept.resize(first);
+            kept.push_back(region);
+        }
+        return region;
+    }
+}
+
+int LeafMerge::mergeLeaves(QuadTree& tree, const vector<vector<RGB>>& image)
+{
+    const ErrorMethod method = tree.getMethod();
+    if (method == Entropy)
+    {
+        return -1;
+    }
+
+    vector<QuadTreeNode*> leaves;
+    tree.collectLeaves(leaves);
+    const int n = static_cast<int>(leaves.size());
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    // Per-leaf statistics: O(1) moments from the integral image, ranges only when needed
+    const IntegralImage& stats = tree.getIntegral(image, ErrorMeasurement::getColorSpace(method));
+    vector<Region> regions(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const Rect& r = leaves[i]->getBounds();
+        regions[i].moments = stats.getMoments(r.x, r.y, r.width, r.height);
+        if (method == MaxPixelDiff)
+        {
+            RGB lo{INT_MAX, INT_MAX, INT_MAX, INT_MAX}, hi{0, 0, 0, 0};
+            for (int y = r.y; y < r.y + r.height; ++y)
+            {
+                for (int x = r.x; x < r.x + r.width; ++x)
+                {
+                    const RGB& p = image[y][x];
+                    lo.r = min(lo.r, p.r); lo.g = min(lo.g, p.g); lo.b = min(lo.b, p.b); lo.a = min(lo.a, p.a);
+                    hi.r = max(hi.r, p.r); hi.g = max(hi.g, p.g); hi.b = max(hi.b, p.b); hi.a = max(hi.a, p.a);
+                }
+            }
+            regions[i].minColor = lo;
+            regions[i].maxColor = hi;
+        }
+    }
+
+    // Adjacency: bucket leaves by the edge coordinates they touch and sweep each line
+    vector<Edge> edges;
+    {
+        unordered_map<int, vector<int>> rightAt, leftAt, bottomAt, topAt;
+        for (int i = 0; i < n; ++i)
+        {
+            const Rect& r = leaves[i]->getBounds();
+            rightAt[r.x + r.width].push_back(i);
+            leftAt[r.x].push_back(i);
+            bottomAt[r.y + r.height].push_back(i);
+            topAt[r.y].push_back(i);
+        }
+        for (auto& entry : rightAt)
+        {
+            auto it = leftAt.find(entry.first);
+            if (it != leftAt.end())
+            {
+                sweepEdge(leaves, entry.second, it->second, true, edges);
+            }
+        }
+        for (auto& entry : bottomAt)
+        {
+            auto it = topAt.find(entry.first);
+            if (it != topAt.end())
+            {
+                sweepEdge(leaves, entry.second, it->second, false, edges);
+            }
+        }
+    }
+
+    // Greedy union-find merge, most similar neighbors first
+    sort(edges.begin(), edges.end(), [](const Edge& l, const Edge& r) { return l.distance < r.distance; });
+    vector<int> parent(n);
+    iota(parent.begin(), parent.end(), 0);
+    int regionCount = n;
+
+    for (const Edge& e : edges)
+    {
+        int ra = findRoot(parent, e.a);
+        int rb = findRoot(parent, e.b);
+        if (ra == rb)
+        {
+            continue;
+        }
+
+        Region merged = regions[ra];
+        merged.moments += regions[rb].moments;
+        const RGB& lo = regions[rb].minColor;
+        const RGB& hi = regions[rb].maxColor;
+        merged.minColor = RGB{min(merged.minColor.r, lo.r), min(merged.minColor.g, lo.g), min(merged.minColor.b, lo.b), min(merged.minColor.a, lo.a)};
+        merged.maxColor = RGB{max(merged.maxColor.r, hi.r), max(merged.maxColor.g, hi.g), max(merged.maxColor.b, hi.b), max(merged.maxColor.a, hi.a)};
+
+        if (regionError(merged, method, tree.getFormat().sampleMax) < tree.getThreshold())
+        {
+            parent[rb] = ra;
+            regions[ra] = merged;
+            --regionCount;
+        }
+    }
+
+    // Region color is the mean of the source pixels it covers, computed in sRGB
+    const IntegralImage& rgb = tree.getIntegral(image, SRGB);
+    vector<BlockMoments> colorSums(n);
+    vector<int> leafRegion(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const Rect& r = leaves[i]->getBounds();
+        leafRegion[i] = findRoot(parent, i);
+        colorSums[leafRegion[i]] += rgb.getMoments(r.x, r.y, r.width, r.height);
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        const BlockMoments& m = colorSums[leafRegion[i]];
+        leaves[i]->setAvgColor(RGB{
+            static_cast<int>(m.getMean(0)),
+            static_cast<int>(m.getMean(1)),
+            static_cast<int>(m.getMean(2)),
+            m.hasAlpha() ? static_cast<int>(m.getMean(3)) : leaves[i]->getAvgColor().a
+        });
+    }
+
+    // Hand the regions to the tree with ids numbered in leaf order
+    vector<int> kept;
+    size_t next = 0;
+    collapseRegions(tree.getRoot(), leafRegion, next, kept);
+    vector<int> id(n, -1);
+    int count = 0;
+    for (int& region : kept)
+    {
+        if (id[region] < 0)
+        {
+            id[region] = count++;
+        }
+        region = id[region];
+    }
+    tree.setLeafRegions(move(kept), count);
+
+    return regionCount;
+}
@@ -1,38 +1,321 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
-#include "header/utils.hpp"
-#include "header/quadTree.hpp"
+#include "header/cli.hpp"
+#include "header/quadtree.hpp"
+#include "header/leafmerge.hpp"
+#include "header/sequence.hpp"
+#include "header/leafcoder.hpp"
+#include "header/daemon.hpp"
+#include "header/ratedistortion.hpp"
+#include "header/thresholdsearch.hpp"
+#include "header/palette.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <filesystem>
 
 using namespace std;
 
-int main() {
+// .qtc stores the tree itself; any other extension gets the reconstructed
+// image. Either way image ends up reconstructed and quality measured.
+static void saveTree(QuadTree& qt, vector<vector<RGB>>& image, const string& outputImagePath, const ImageFormat& format, QualityStats& quality, bool indexed = false)
+{
+    if (indexed)
+    {
+        // The index image comes from the leaves; reconstructing only measures quality
+        qt.reconstructImage(image, &quality);
+        if (Palette::writeIndexed(qt, outputImagePath))
+        {
+            cout << "Gambar berpalet berhasil disimpan ke: " << outputImagePath << '\n';
+        }
+        else
+        {
+            cerr << "Gagal menyimpan gambar berpalet ke: " << outputImagePath << '\n';
+        }
+    }
+    else if (hasExtension(outputImagePath, ".qtc"))
+    {
+        string error;
+        if (LeafCoder::encode(qt, outputImagePath, &error))
+        {
+            cout << "Quadtree terkode disimpan ke: " << outputImagePath << '\n';
+        }
+        else
+        {
+            cerr << "Gagal: " << error << '\n';
+        }
+        // A .qtc file decodes to exactly the leaf colors, so measure those
+        qt.reconstructImage(image, &quality);
+    }
+    else
+    {
+        qt.reconstructImage(image, &quality);
+        saveCompressedImage(image, outputImagePath, format);
+    }
+}
+
+// main.exe --decode <input.qtc> <output>
+// main.exe --decode <folder_sequence> <folder_output>
+static int decodeHandler(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        cerr << "Penggunaan: " << argv[0] << " --decode <input.qtc> <output>\n"
+             << "            " << argv[0] << " --decode <folder_sequence> <folder_output>\n";
+        return EXIT_FAILURE;
+    }
+    if (filesystem::is_directory(argv[2]))
+    {
+        return Sequence::decodeSequence(argv[2], argv[3]);
+    }
+
+    vector<vector<RGB>> image;
+    ImageFormat format;
+    auto start = chrono::high_resolution_clock::now();
+    string error;
+    if (!LeafCoder::decode(argv[2], image, format, &error))
+    {
+        cerr << "Gagal: " << error << '\n';
+        return EXIT_FAILURE;
+    }
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start);
+    cout << "File .qtc didekode dalam " << duration.count() << " ms\n";
+
+    saveCompressedImage(image, argv[3], format);
+    return 0;
+}
+
+// main.exe --rd <input> <output> <bytes|psnr|lambda> <nilai> [ukuran_blok_min]
+static int rateDistortionHandler(int argc, char* argv[])
+{
+    if (argc < 6)
+    {
+        cerr << "Penggunaan: " << argv[0] << " --rd <input> <output> <bytes|psnr|lambda> <nilai> [ukuran_blok_min]\n";
+        return EXIT_FAILURE;
+    }
+
+    RateDistortion::Target target;
+    string kind = argv[4];
+    if (kind == "bytes")
+    {
+        target.kind = RateDistortion::TargetBytes;
+    }
+    else if (kind == "psnr")
+    {
+        target.kind = RateDistortion::TargetPSNR;
+    }
+    else if (kind == "lambda")
+    {
+        target.kind = RateDistortion::TargetLambda;
+    }
+    else
+    {
+        cerr << "Jenis target tidak dikenali: " << kind << " (bytes, psnr atau lambda)\n";
+        return EXIT_FAILURE;
+    }
+    target.value = atof(argv[5]);
+    int minBlockSize = (argc > 6) ? atoi(argv[6]) : 2;
+    if (target.value <= 0.0 && target.kind != RateDistortion::TargetLambda)
+    {
+        cerr << "Nilai target harus lebih besar dari 0.\n";
+        return EXIT_FAILURE;
+    }
+    if (minBlockSize < 1)
+    {
+        cerr << "Ukuran blok minimum harus >= 1.\n";
+        return EXIT_FAILURE;
+    }
+
+    string inputImagePath = argv[2], outputImagePath = argv[3];
+    vector<vector<RGB>> image;
+    ImageFormat format;
+    if (!processImage(inputImagePath, image, format))
+    {
+        return EXIT_FAILURE;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+
+    QuadTree qt;
+    qt.prepareRateDistortion(image, 0, 0, image[0].size(), image.size(), minBlockSize, format);
+    RateDistortion::Result result;
+    if (!RateDistortion::fit(qt, target, result))
+    {
+        cout << "Target tidak dapat dicapai, memakai hasil terdekat.\n";
+    }
+    cout << "Lambda: " << result.lambda << " (" << result.probes << " percobaan), estimasi PSNR: ";
+    if (isinf(result.psnr))
+    {
+        cout << "tak hingga";
+    }
+    else
+    {
+        cout << result.psnr << " dB";
+    }
+    cout << ", ukuran .qtc: " << result.bytes << " byte\n";
+
+    QualityStats quality;
+    saveTree(qt, image, outputImagePath, format, quality);
+
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start);
+    outputHandler(outputImagePath, inputImagePath, qt.getMaxDepth(), qt.getNodeCount(), duration, -1, &quality);
+    return 0;
+}
+
+// main.exe --target-psnr|--target-ssim <input> <output> <metode> <nilai> [ukuran_blok_min]
+static int targetQualityHandler(int argc, char* argv[])
+{
+    const string mode = argv[1];
+    if (argc < 6)
+    {
+        cerr << "Penggunaan: " << argv[0] << ' ' << mode << " <input> <output> <metode> <nilai> [ukuran_blok_min]\n";
+        return EXIT_FAILURE;
+    }
+
+    const ThresholdSearch::Metric metric = (mode == "--target-ssim") ? ThresholdSearch::TargetSSIM : ThresholdSearch::TargetPSNR;
+    string methodStr = argv[4];
+    transform(methodStr.begin(), methodStr.end(), methodStr.begin(), ::tolower);
+    replace(methodStr.begin(), methodStr.end(), '_', ' ');
+    ErrorMethod method;
+    if (!parseErrorMethod(methodStr, method))
+    {
+        cerr << "Metode error tidak dikenali: " << methodStr << '\n';
+        return EXIT_FAILURE;
+    }
+    double target = atof(argv[5]);
+    if (target <= 0.0 || (metric == ThresholdSearch::TargetSSIM && target > 1.0))
+    {
+        cerr << "Target kualitas tidak valid (PSNR > 0 dB, SSIM di antara 0 dan 1).\n";
+        return EXIT_FAILURE;
+    }
+    int minBlockSize = (argc > 6) ? atoi(argv[6]) : 2;
+    if (minBlockSize < 1)
+    {
+        cerr << "Ukuran blok minimum harus >= 1.\n";
+        return EXIT_FAILURE;
+    }
+
+    string inputImagePath = argv[2], outputImagePath = argv[3];
+    vector<vector<RGB>> image;
+    ImageFormat format;
+    if (!processImage(inputImagePath, image, format))
+    {
+        return EXIT_FAILURE;
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+
+    QuadTree qt;
+    qt.prepareThresholdSearch(image, 0, 0, image[0].size(), image.size(), method, minBlockSize, format);
+    ThresholdSearch::Result result;
+    if (!ThresholdSearch::fit(qt, metric, target, result))
+    {
+        cout << "Target tidak dapat dicapai pada ukuran blok minimum ini, memakai quadtree penuh.\n";
+    }
+    cout << "Threshold: " << result.threshold << " (" << result.probes << " percobaan), estimasi PSNR: ";
+    if (isinf(result.quality.psnr))
+    {
+        cout << "tak hingga";
+    }
+    else
+    {
+        cout << result.quality.psnr << " dB";
+    }
+    cout << ", estimasi SSIM: " << result.quality.ssim << '\n';
+
+    QualityStats quality;
+    saveTree(qt, image, outputImagePath, format, quality);
+
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start);
+    outputHandler(outputImagePath, inputImagePath, qt.getMaxDepth(), qt.getNodeCount(), duration, -1, &quality);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--sequence")
+    {
+        return Sequence::sequenceHandler(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--decode")
+    {
+        return decodeHandler(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--rd")
+    {
+        return rateDistortionHandler(argc, argv);
+    }
+    if (argc > 1 && (string(argv[1]) == "--target-psnr" || string(argv[1]) == "--target-ssim"))
+    {
+        return targetQualityHandler(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--daemon")
+    {
+        return Daemon::daemonHandler(argc, argv);
+    }
+
     string inputImagePath, errorMethodStr, outputImagePath;
     ErrorMethod method;
+    SplitMode splitMode = QuadSplit;
+    bool mergeLeaves = false;
+    bool sampling = false;
+    int paletteColors = 0;
     vector<vector<RGB>> image;
     float threshold = 0.0f;
-    int minBlockSize = 2, maxDepth = 0, nodeCount = 0;
+    int minBlockSize = 2, maxDepth = 0, nodeCount = 0, regionCount = -1;
+    ImageFormat format;
 
     // Handle user input and load the image
-    inputHandler(inputImagePath, image, errorMethodStr, method, threshold, minBlockSize, outputImagePath);
+    inputHandler(inputImagePath, image, format, errorMethodStr, method, threshold, minBlockSize, splitMode, mergeLeaves, sampling, paletteColors, outputImagePath);
 
     // Start timing the compression process
     auto start = chrono::high_resolution_clock::now();
 
     QuadTree qt;
-    qt.buildTree(image, 0, 0, image[0].size(), image.size(), method, threshold, minBlockSize);
+    qt.setSampling(sampling);
+    qt.buildTree(image, 0, 0, image[0].size(), image.size(), method, threshold, minBlockSize, splitMode, format);
+
+    if (sampling)
+    {
+        const SamplingStats& sampled = qt.getSamplingStats();
+        cout << "Split dari sampel: " << sampled.sampled << " blok, " << sampled.fallbacks
+             << " blok dihitung penuh (perkiraan split keliru <= " << sampled.expectedMistakes << ")\n";
+    }
+
+    // Optional post-pass: fuse neighboring leaves that fit under the threshold together
+    if (mergeLeaves)
+    {
+        regionCount = LeafMerge::mergeLeaves(qt, image);
+    }
+    // Merging collapses subtrees that fell inside one region
     maxDepth = qt.getMaxDepth();
     nodeCount = qt.getNodeCount();
 
-    qt.reconstructImage(image);
-    saveCompressedImage(image, outputImagePath);
+    // Optional: reduce the leaf colors to a palette and write an indexed PNG
+    bool indexed = false;
+    if (paletteColors > 0)
+    {
+        if (format.sampleMax > 255)
+        {
+            cout << "Palet hanya didukung untuk gambar 8-bit, dilewati.\n";
+        }
+        else
+        {
+            int colors = Palette::quantize(qt, paletteColors);
+            cout << "Palet: " << colors << " warna\n";
+            indexed = true;
+        }
+    }
+
+    QualityStats quality;
+    saveTree(qt, image, outputImagePath, format, quality, indexed);
 
     // End timing
     auto end = chrono::high_resolution_clock::now();
     auto duration = chrono::duration_cast<chrono::milliseconds>(end - start);
 
     // Display output summary
-    outputHandler(outputImagePath, inputImagePath, maxDepth, nodeCount, duration);
+    outputHandler(outputImagePath, inputImagePath, maxDepth, nodeCount, duration, regionCount, &quality);
 
     return 0;
 }
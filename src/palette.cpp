@@ -0,0 +1,252 @@
+#include "header/palette.hpp"
+#include "header/pngwriter.hpp"
+#include "header/threadpool.hpp"
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+namespace
+{
+    const int ACTIVE_LANES[5][4] = { {}, {0}, {0, 3}, {0, 1, 2}, {0, 1, 2, 3} };
+
+    int laneValue(const RGB& color, int lane)
+    {
+        switch (lane)
+        {
+        case 0: return color.r;
+        case 1: return color.g;
+        case 2: return color.b;
+        default: return color.a;
+        }
+    }
+
+    uint64_t colorKey(const RGB& c)
+    {
+        return (static_cast<uint64_t>(c.r & 0xFFFF) << 48) | (static_cast<uint64_t>(c.g & 0xFFFF) << 32)
+             | (static_cast<uint64_t>(c.b & 0xFFFF) << 16) | static_cast<uint64_t>(c.a & 0xFFFF);
+    }
+
+    // One distinct leaf color and the pixel area it covers
+    struct Entry
+    {
+        RGB color;
+        double weight;
+    };
+
+    struct Box
+    {
+        size_t begin;
+        size_t end;
+        double score;   // weighted squared error of the box, < 0 when it cannot split
+        int lane;       // lane with the largest spread
+    };
+
+    void measure(Box& box, const vector<Entry>& entries, int channels)
+    {
+        box.score = -1.0;
+        box.lane = ACTIVE_LANES[channels][0];
+        if (box.end - box.begin < 2)
+        {
+            return;
+        }
+
+        double bestSpread = -1.0;
+        double total = 0.0;
+        for (int k = 0; k < channels; ++k)
+        {
+            int lane = ACTIVE_LANES[channels][k];
+            double w = 0.0, sum = 0.0, sumSq = 0.0;
+            for (size_t i = box.begin; i < box.end; ++i)
+            {
+                double v = laneValue(entries[i].color, lane);
+                w += entries[i].weight;
+                sum += entries[i].weight * v;
+                sumSq += entries[i].weight * v * v;
+            }
+            double spread = max(0.0, sumSq - sum * sum / w);
+            total += spread;
+            if (spread > bestSpread)
+            {
+                bestSpread = spread;
+                box.lane = lane;
+            }
+        }
+        box.score = total;
+    }
+
+    // Cuts the box at the area-weighted median of its widest lane
+    Box split(Box& box, vector<Entry>& entries)
+    {
+        const int lane = box.lane;
+        sort(entries.begin() + box.begin, entries.begin() + box.end, [lane](const Entry& a, const Entry& b)
+        {
+            return laneValue(a.color, lane) < laneValue(b.color, lane);
+        });
+
+        double total = 0.0;
+        for (size_t i = box.begin; i < box.end; ++i)
+        {
+            total += entries[i].weight;
+        }
+        size_t cut = box.begin + 1;
+        double acc = entries[box.begin].weight;
+        while (cut + 1 < box.end && acc + entries[cut].weight <= total / 2)
+        {
+            acc += entries[cut++].weight;
+        }
+
+        Box upper{cut, box.end, -1.0, lane};
+        box.end = cut;
+        return upper;
+    }
+
+    RGB boxColor(const Box& box, const vector<Entry>& entries, int channels)
+    {
+        double w = 0.0;
+        double sum[4] = {0.0, 0.0, 0.0, 0.0};
+        for (size_t i = box.begin; i < box.end; ++i)
+        {
+            const RGB& c = entries[i].color;
+            w += entries[i].weight;
+            sum[0] += entries[i].weight * c.r;
+            sum[1] += entries[i].weight * c.g;
+            sum[2] += entries[i].weight * c.b;
+            sum[3] += entries[i].weight * c.a;
+        }
+        RGB color{static_cast<int>(lround(sum[0] / w)), static_cast<int>(lround(sum[1] / w)),
+                  static_cast<int>(lround(sum[2] / w)), 255};
+        if (channels == 2 || channels == 4)
+        {
+            color.a = static_cast<int>(lround(sum[3] / w));
+        }
+        return color;
+    }
+}
+
+int Palette::quantize(QuadTree& tree, int maxColors)
+{
+    maxColors = max(1, min(maxColors, MAX_COLORS));
+    vector<QuadTreeNode*> leaves;
+    tree.collectLeaves(leaves);
+    if (leaves.empty())
+    {
+        return 0;
+    }
+    const int channels = tree.getFormat().channels;
+
+    unordered_map<uint64_t, size_t> slot;
+    vector<Entry> entries;
+    for (const QuadTreeNode* leaf : leaves)
+    {
+        const Rect& b = leaf->getBounds();
+        auto it = slot.emplace(colorKey(leaf->getAvgColor()), entries.size());
+        if (it.second)
+        {
+            entries.push_back(Entry{leaf->getAvgColor(), 0.0});
+        }
+        entries[it.first->second].weight += static_cast<double>(b.width) * b.height;
+    }
+    if (entries.size() <= static_cast<size_t>(maxColors))
+    {
+        return static_cast<int>(entries.size());
+    }
+
+    // Always split the box holding the most squared error
+    vector<Box> boxes{Box{0, entries.size(), -1.0, 0}};
+    measure(boxes[0], entries, channels);
+    while (boxes.size() < static_cast<size_t>(maxColors))
+    {
+        size_t worst = 0;
+        for (size_t i = 1; i < boxes.size(); ++i)
+        {
+            if (boxes[i].score > boxes[worst].score)
+            {
+                worst = i;
+            }
+        }
+        if (boxes[worst].score <= 0.0)
+        {
+            break;
+        }
+        Box upper = split(boxes[worst], entries);
+        measure(boxes[worst], entries, channels);
+        measure(upper, entries, channels);
+        boxes.push_back(upper);
+    }
+
+    unordered_map<uint64_t, RGB> mapped;
+    mapped.reserve(entries.size());
+    for (const Box& box : boxes)
+    {
+        const RGB color = boxColor(box, entries, channels);
+        for (size_t i = box.begin; i < box.end; ++i)
+        {
+            mapped[colorKey(entries[i].color)] = color;
+        }
+    }
+    for (QuadTreeNode* leaf : leaves)
+    {
+        leaf->setAvgColor(mapped[colorKey(leaf->getAvgColor())]);
+    }
+    return static_cast<int>(boxes.size());
+}
+
+bool Palette::writeIndexed(const QuadTree& tree, const string& path)
+{
+    const QuadTreeNode* root = tree.getRoot();
+    const ImageFormat& format = tree.getFormat();
+    if (root == nullptr || format.sampleMax > 255)
+    {
+        return false;
+    }
+
+    vector<QuadTreeNode*> leaves;
+    tree.collectLeaves(leaves);
+
+    const bool hasAlpha = (format.channels == 2 || format.channels == 4);
+    bool translucent = false;
+    unordered_map<uint64_t, uint8_t> index;
+    vector<uint8_t> palette, alpha;
+    vector<uint8_t> leafIndex(leaves.size());
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        const RGB c = leaves[i]->getAvgColor();
+        auto it = index.find(colorKey(c));
+        if (it == index.end())
+        {
+            if (index.size() == static_cast<size_t>(MAX_COLORS))
+            {
+                return false;
+            }
+            it = index.emplace(colorKey(c), static_cast<uint8_t>(index.size())).first;
+            palette.push_back(static_cast<uint8_t>(c.r));
+            palette.push_back(static_cast<uint8_t>(c.g));
+            palette.push_back(static_cast<uint8_t>(c.b));
+            alpha.push_back(static_cast<uint8_t>(hasAlpha ? c.a : 255));
+            translucent = translucent || alpha.back() != 255;
+        }
+        leafIndex[i] = it->second;
+    }
+
+    // One byte per pixel; leaves never overlap, so they fill in parallel
+    const Rect& bounds = root->getBounds();
+    const size_t width = static_cast<size_t>(bounds.width);
+    vector<uint8_t> rows(width * bounds.height);
+    ThreadPool::shared().parallelFor(0, leaves.size(), 256, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            const Rect& b = leaves[i]->getBounds();
+            for (int y = b.y; y < b.y + b.height; ++y)
+            {
+                memset(rows.data() + (y - bounds.y) * width + (b.x - bounds.x), leafIndex[i], b.width);
+            }
+        }
+    });
+
+    return PngWriter::write(path, bounds.width, bounds.height, PngWriter::Indexed, 8, rows, palette,
+                            translucent ? alpha : vector<uint8_t>());
+}
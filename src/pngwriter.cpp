@@ -0,0 +1,241 @@
+#include "header/pngwriter.hpp"
+#include <fstream>
+#include <array>
+#include <cstdlib>
+#include <algorithm>
+#include <climits>
+
+// Exported by the stb_image_write implementation compiled in utils.cpp
+extern "C" unsigned char* stbi_zlib_compress(unsigned char* data, int data_len, int* out_len, int quality);
+
+namespace
+{
+    // PNG chunk lengths stop at 2^31 - 1; image data is split into IDAT
+    // chunks of at most this size
+    const size_t MAX_IDAT_CHUNK = size_t(1) << 30;
+    // Deflate stored blocks hold at most 65535 bytes each
+    const size_t STORED_BLOCK = 65535;
+    // Bytes that can be summed before the Adler-32 sums must be reduced (zlib's NMAX)
+    const size_t ADLER_NMAX = 5552;
+    const uint32_t ADLER_BASE = 65521;
+
+    uint32_t crc32(const uint8_t* data, size_t len, uint32_t crc = 0)
+    {
+        static const array<uint32_t, 256> table = [] {
+            array<uint32_t, 256> t{};
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        crc = ~crc;
+        for (size_t i = 0; i < len; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void putBE32(vector<uint8_t>& out, uint32_t v)
+    {
+        out.push_back(static_cast<uint8_t>(v >> 24));
+        out.push_back(static_cast<uint8_t>(v >> 16));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    void writeChunk(ofstream& file, const char* type, const uint8_t* data, size_t len)
+    {
+        vector<uint8_t> word;
+        putBE32(word, static_cast<uint32_t>(len));
+        file.write(reinterpret_cast<const char*>(word.data()), 4);
+        file.write(type, 4);
+        file.write(reinterpret_cast<const char*>(data), static_cast<streamsize>(len));
+        word.clear();
+        putBE32(word, crc32(data, len, crc32(reinterpret_cast<const uint8_t*>(type), 4)));
+        file.write(reinterpret_cast<const char*>(word.data()), 4);
+    }
+
+    uint32_t adler32(const uint8_t* data, size_t len)
+    {
+        uint32_t a = 1, b = 0;
+        while (len > 0)
+        {
+            size_t n = min(len, ADLER_NMAX);
+            len -= n;
+            for (; n > 0; --n)
+            {
+                a += *data++;
+                b += a;
+            }
+            a %= ADLER_BASE;
+            b %= ADLER_BASE;
+        }
+        return (b << 16) | a;
+    }
+
+    // zlib stream of uncompressed deflate blocks, for data beyond the int
+    // length stb's deflate accepts. The file gets large but stays valid.
+    vector<uint8_t> storedZlib(const vector<uint8_t>& data)
+    {
+        vector<uint8_t> out;
+        out.reserve(data.size() + (data.size() / STORED_BLOCK + 1) * 5 + 6);
+        out.push_back(0x78);
+        out.push_back(0x01);
+        size_t pos = 0;
+        do
+        {
+            const size_t len = min(STORED_BLOCK, data.size() - pos);
+            const bool last = pos + len == data.size();
+            out.push_back(last ? 1 : 0);
+            out.push_back(static_cast<uint8_t>(len));
+            out.push_back(static_cast<uint8_t>(len >> 8));
+            out.push_back(static_cast<uint8_t>(~len));
+            out.push_back(static_cast<uint8_t>(~len >> 8));
+            out.insert(out.end(), data.begin() + pos, data.begin() + pos + len);
+            pos += len;
+        } while (pos < data.size());
+        putBE32(out, adler32(data.data(), data.size()));
+        return out;
+    }
+
+    uint8_t paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+        if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+        if (pb <= pc) return static_cast<uint8_t>(b);
+        return static_cast<uint8_t>(c);
+    }
+
+    // Picks the filter with the smallest sum of absolute residuals per row, as libpng does
+    void filterRow(const uint8_t* row, const uint8_t* prev, size_t rowBytes, int bpp, vector<uint8_t>& out)
+    {
+        array<vector<uint8_t>, 5> candidate;
+        long long bestCost = -1;
+        int best = 0;
+
+        for (int type = 0; type < 5; ++type)
+        {
+            vector<uint8_t>& f = candidate[type];
+            f.resize(rowBytes);
+            long long cost = 0;
+            for (size_t i = 0; i < rowBytes; ++i)
+            {
+                int a = (i >= static_cast<size_t>(bpp)) ? row[i - bpp] : 0;
+                int b = prev ? prev[i] : 0;
+                int c = (prev && i >= static_cast<size_t>(bpp)) ? prev[i - bpp] : 0;
+                uint8_t predicted = 0;
+                switch (type)
+                {
+                case 1: predicted = static_cast<uint8_t>(a); break;
+                case 2: predicted = static_cast<uint8_t>(b); break;
+                case 3: predicted = static_cast<uint8_t>((a + b) / 2); break;
+                case 4: predicted = paeth(a, b, c); break;
+                default: break;
+                }
+                f[i] = static_cast<uint8_t>(row[i] - predicted);
+                cost += abs(static_cast<int8_t>(f[i]));
+            }
+            if (bestCost < 0 || cost < bestCost)
+            {
+                bestCost = cost;
+                best = type;
+            }
+        }
+
+        out.push_back(static_cast<uint8_t>(best));
+        out.insert(out.end(), candidate[best].begin(), candidate[best].end());
+    }
+}
+
+PngWriter::ColorType PngWriter::colorTypeFor(int channels)
+{
+    switch (channels)
+    {
+    case 1: return Gray;
+    case 2: return GrayAlpha;
+    case 4: return TruecolorAlpha;
+    default: return Truecolor;
+    }
+}
+
+bool PngWriter::write(const string& path, int width, int height, ColorType colorType, int bitDepth,
+                      const vector<uint8_t>& rows, const vector<uint8_t>& palette,
+                      const vector<uint8_t>& transparency)
+{
+    int samples = 1;
+    switch (colorType)
+    {
+    case GrayAlpha: samples = 2; break;
+    case Truecolor: samples = 3; break;
+    case TruecolorAlpha: samples = 4; break;
+    default: break;
+    }
+    const int bpp = max(1, samples * bitDepth / 8);
+    const size_t rowBytes = (static_cast<size_t>(width) * samples * bitDepth + 7) / 8;
+    if (rows.size() < rowBytes * height || (colorType == Indexed && palette.empty()))
+    {
+        return false;
+    }
+
+    vector<uint8_t> filtered;
+    filtered.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t* prev = (y > 0) ? rows.data() + (y - 1) * rowBytes : nullptr;
+        filterRow(rows.data() + y * rowBytes, prev, rowBytes, bpp, filtered);
+    }
+
+    vector<uint8_t> zlib;
+    if (filtered.size() <= static_cast<size_t>(INT_MAX))
+    {
+        int zlen = 0;
+        unsigned char* compressed = stbi_zlib_compress(filtered.data(), static_cast<int>(filtered.size()), &zlen, 8);
+        if (!compressed)
+        {
+            return false;
+        }
+        zlib.assign(compressed, compressed + zlen);
+        free(compressed);
+    }
+    else
+    {
+        zlib = storedZlib(filtered);
+    }
+    vector<uint8_t>().swap(filtered);
+
+    ofstream file(path, ios::binary);
+    const char signature[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1A', '\n'};
+    file.write(signature, sizeof(signature));
+    vector<uint8_t> header;
+    putBE32(header, static_cast<uint32_t>(width));
+    putBE32(header, static_cast<uint32_t>(height));
+    header.push_back(static_cast<uint8_t>(bitDepth));
+    header.push_back(static_cast<uint8_t>(colorType));
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // no interlace
+    writeChunk(file, "IHDR", header.data(), header.size());
+    if (colorType == Indexed)
+    {
+        writeChunk(file, "PLTE", palette.data(), palette.size());
+        if (!transparency.empty())
+        {
+            writeChunk(file, "tRNS", transparency.data(), transparency.size());
+        }
+    }
+    for (size_t pos = 0; pos < zlib.size(); pos += MAX_IDAT_CHUNK)
+    {
+        writeChunk(file, "IDAT", zlib.data() + pos, min(MAX_IDAT_CHUNK, zlib.size() - pos));
+    }
+    writeChunk(file, "IEND", nullptr, 0);
+    return file.good();
+}
@@ -0,0 +1,231 @@
+#include "header/qoi.hpp"
+#include <array>
+#include <cstring>
+#include <climits>
+
+namespace
+{
+    const uint8_t MAGIC[4] = {'q', 'o', 'i', 'f'};
+    const size_t HEADER_SIZE = 14;
+    const uint8_t PADDING[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+    const uint8_t OP_INDEX = 0x00;
+    const uint8_t OP_DIFF = 0x40;
+    const uint8_t OP_LUMA = 0x80;
+    const uint8_t OP_RUN = 0xC0;
+    const uint8_t OP_RGB = 0xFE;
+    const uint8_t OP_RGBA = 0xFF;
+    const uint8_t MASK_2 = 0xC0;
+    const int MAX_RUN = 62;
+
+    struct Pixel
+    {
+        uint8_t r, g, b, a;
+
+        bool operator==(const Pixel& o) const { return r == o.r && g == o.g && b == o.b && a == o.a; }
+        int hash() const { return (r * 3 + g * 5 + b * 7 + a * 11) % 64; }
+    };
+
+    void putBE32(vector<uint8_t>& out, uint32_t v)
+    {
+        out.push_back(static_cast<uint8_t>(v >> 24));
+        out.push_back(static_cast<uint8_t>(v >> 16));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    uint32_t getBE32(const uint8_t* p)
+    {
+        return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+}
+
+bool Qoi::encode(const uint8_t* pixels, int width, int height, int channels, vector<uint8_t>& out)
+{
+    if (pixels == nullptr || width <= 0 || height <= 0 || (channels != 3 && channels != 4))
+    {
+        return false;
+    }
+
+    const size_t count = static_cast<size_t>(width) * height;
+    out.clear();
+    out.reserve(HEADER_SIZE + count / 4 + sizeof(PADDING));
+    out.insert(out.end(), MAGIC, MAGIC + 4);
+    putBE32(out, static_cast<uint32_t>(width));
+    putBE32(out, static_cast<uint32_t>(height));
+    out.push_back(static_cast<uint8_t>(channels));
+    out.push_back(0); // sRGB with linear alpha
+
+    array<Pixel, 64> index{};
+    Pixel prev{0, 0, 0, 255};
+    int run = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t* p = pixels + i * channels;
+        Pixel px{p[0], p[1], p[2], channels == 4 ? p[3] : static_cast<uint8_t>(255)};
+
+        if (px == prev)
+        {
+            if (++run == MAX_RUN || i + 1 == count)
+            {
+                out.push_back(static_cast<uint8_t>(OP_RUN | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            out.push_back(static_cast<uint8_t>(OP_RUN | (run - 1)));
+            run = 0;
+        }
+
+        const int h = px.hash();
+        if (index[h] == px)
+        {
+            out.push_back(static_cast<uint8_t>(OP_INDEX | h));
+        }
+        else
+        {
+            index[h] = px;
+            if (px.a == prev.a)
+            {
+                const int vr = static_cast<int8_t>(px.r - prev.r);
+                const int vg = static_cast<int8_t>(px.g - prev.g);
+                const int vb = static_cast<int8_t>(px.b - prev.b);
+                const int vgr = vr - vg;
+                const int vgb = vb - vg;
+                if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+                {
+                    out.push_back(static_cast<uint8_t>(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                }
+                else if (vgr >= -8 && vgr <= 7 && vg >= -32 && vg <= 31 && vgb >= -8 && vgb <= 7)
+                {
+                    out.push_back(static_cast<uint8_t>(OP_LUMA | (vg + 32)));
+                    out.push_back(static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8)));
+                }
+                else
+                {
+                    out.push_back(OP_RGB);
+                    out.push_back(px.r);
+                    out.push_back(px.g);
+                    out.push_back(px.b);
+                }
+            }
+            else
+            {
+                out.push_back(OP_RGBA);
+                out.push_back(px.r);
+                out.push_back(px.g);
+                out.push_back(px.b);
+                out.push_back(px.a);
+            }
+        }
+        prev = px;
+    }
+
+    out.insert(out.end(), PADDING, PADDING + sizeof(PADDING));
+    return true;
+}
+
+bool Qoi::isQoi(const uint8_t* bytes, size_t size)
+{
+    return bytes != nullptr && size >= HEADER_SIZE && memcmp(bytes, MAGIC, 4) == 0;
+}
+
+bool Qoi::decode(const uint8_t* bytes, size_t size, vector<uint8_t>& pixels, int& width, int& height, int& channels)
+{
+    if (!isQoi(bytes, size) || size < HEADER_SIZE + sizeof(PADDING))
+    {
+        return false;
+    }
+    const uint32_t w = getBE32(bytes + 4);
+    const uint32_t h = getBE32(bytes + 8);
+    channels = bytes[12];
+    if (w == 0 || h == 0 || w > INT_MAX || h > INT_MAX || (channels != 3 && channels != 4))
+    {
+        return false;
+    }
+    // No op covers more than MAX_RUN pixels per byte, so a header promising
+    // more pixels than that is corrupt; checked before allocating
+    if (static_cast<uint64_t>(w) * h > static_cast<uint64_t>(size - HEADER_SIZE - sizeof(PADDING)) * MAX_RUN)
+    {
+        return false;
+    }
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+
+    const size_t count = static_cast<size_t>(w) * h;
+    const size_t end = size - sizeof(PADDING);
+    pixels.resize(count * channels);
+
+    array<Pixel, 64> index{};
+    Pixel px{0, 0, 0, 255};
+    size_t pos = HEADER_SIZE;
+    int run = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (run > 0)
+        {
+            --run;
+        }
+        else if (pos < end)
+        {
+            const uint8_t b1 = bytes[pos++];
+            if (b1 == OP_RGB)
+            {
+                if (pos + 3 > end) return false;
+                px.r = bytes[pos];
+                px.g = bytes[pos + 1];
+                px.b = bytes[pos + 2];
+                pos += 3;
+            }
+            else if (b1 == OP_RGBA)
+            {
+                if (pos + 4 > end) return false;
+                px.r = bytes[pos];
+                px.g = bytes[pos + 1];
+                px.b = bytes[pos + 2];
+                px.a = bytes[pos + 3];
+                pos += 4;
+            }
+            else if ((b1 & MASK_2) == OP_INDEX)
+            {
+                px = index[b1];
+            }
+            else if ((b1 & MASK_2) == OP_DIFF)
+            {
+                px.r += ((b1 >> 4) & 0x03) - 2;
+                px.g += ((b1 >> 2) & 0x03) - 2;
+                px.b += (b1 & 0x03) - 2;
+            }
+            else if ((b1 & MASK_2) == OP_LUMA)
+            {
+                if (pos + 1 > end) return false;
+                const uint8_t b2 = bytes[pos++];
+                const int vg = (b1 & 0x3F) - 32;
+                px.r += vg - 8 + ((b2 >> 4) & 0x0F);
+                px.g += vg;
+                px.b += vg - 8 + (b2 & 0x0F);
+            }
+            else
+            {
+                run = b1 & 0x3F;
+            }
+            index[px.hash()] = px;
+        }
+        else
+        {
+            return false;
+        }
+
+        uint8_t* dst = pixels.data() + i * channels;
+        dst[0] = px.r;
+        dst[1] = px.g;
+        dst[2] = px.b;
+        if (channels == 4)
+        {
+            dst[3] = px.a;
+        }
+    }
+    return true;
+}
@@ -1,12 +1,229 @@
 #include "header/quadtree.hpp"
 #include "header/errormeasurement.hpp"
+#include "header/blockpyramid.hpp"
+#include "header/integralimage.hpp"
+#include "header/threadpool.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-QuadTreeNode::QuadTreeNode(): bounds{0, 0, 0, 0}, isLeaf(true), avgColor{0, 0, 0}
+namespace
+{
+    // Leaf rows at least this wide bypass the cache with streaming stores; a
+    // large output is written once and never read back while reconstructing.
+    const int STREAM_MIN_SPAN = 64;
+
+    void fillSpan(RGB* dst, int count, const RGB& color)
+    {
+#ifdef __SSE2__
+        static_assert(sizeof(RGB) == 16, "RGB is stored as one 128-bit lane");
+        if (count >= STREAM_MIN_SPAN && (reinterpret_cast<uintptr_t>(dst) & 15) == 0)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&color));
+            for (int i = 0; i < count; ++i)
+            {
+                _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), v);
+            }
+            return;
+        }
+#endif
+        fill(dst, dst + count, color);
+    }
+
+    // Upper bound on retained free nodes per thread (about 150 MB)
+    const size_t MAX_FREE_NODES = size_t(1) << 21;
+
+    struct NodeFreeList
+    {
+        vector<void*> blocks;
+
+        ~NodeFreeList()
+        {
+            for (void* block : blocks)
+            {
+                ::operator delete(block);
+            }
+        }
+    };
+
+    thread_local NodeFreeList nodeFreeList;
+
+    // Nearest float not above v, so a stored lower bound stays one
+    float floorToFloat(double v)
+    {
+        float f = static_cast<float>(v);
+        return (static_cast<double>(f) > v) ? nextafterf(f, -numeric_limits<float>::infinity()) : f;
+    }
+
+    // The normalized error of a Variance or MAD numerator, rounded down so
+    // it stays a lower bound
+    float numeratorError(ErrorMethod method, unsigned long long numerator, const ImageFormat& format, long long pixels)
+    {
+        const double scale = format.sampleMax / 255.0;
+        const double unit = (method == Variance) ? scale * scale : scale;
+        return floorToFloat(static_cast<double>(numerator) / (unit * format.channels * static_cast<double>(pixels)) * (1.0 - 1e-12));
+    }
+
+    double binaryEntropy(double p)
+    {
+        return (p <= 0.0 || p >= 1.0) ? 0.0 : -(p * log2(p) + (1.0 - p) * log2(1.0 - p));
+    }
+
+    // Most a block's error can fall when a fraction f of its pixels changes,
+    // in the normalized units the threshold uses; negative when unbounded.
+    // Variance: the unchanged pixels about their own mean keep their sum of
+    // squares, and the old total was at most that plus 255^2 per changed
+    // sample. MAD: the same argument gives 255 per changed sample, plus the
+    // mean moving by at most f*255, plus 1 since the kernel floors the mean.
+    // Entropy: each histogram moves by at most f in total variation, worth
+    // f*log2(255) + h2(f) bits, plus slack for float sums.
+    double editDrop(ErrorMethod method, double f)
+    {
+        switch (method)
+        {
+            case Variance: return f * 255.0 * 255.0 + 1.0;
+            case MAD:      return 2.0 * f * 255.0 + 1.0;
+            case Entropy:  return f * log2(255.0) + binaryEntropy(min(f, 0.5)) + 1e-3;
+            default:       return -1.0;
+        }
+    }
+
+    // Rate model for pruning: one flag per splittable block, and per leaf channel
+    // an Elias-gamma length plus sign for the residual against the parent mean,
+    // a rough stand-in for what LeafCoder spends on a leaf color
+    const float SPLIT_FLAG_BITS = 1.0f;
+
+    float residualBits(int residual)
+    {
+        unsigned int magnitude = static_cast<unsigned int>(abs(residual));
+        if (magnitude == 0)
+        {
+            return 1.0f;
+        }
+        int length = 0;
+        for (unsigned int v = magnitude + 1; v > 1; v >>= 1)
+        {
+            ++length;
+        }
+        return static_cast<float>(2 * length + 2);
+    }
+
+    float colorBits(const RGB& color, const RGB& predicted, int channels)
+    {
+        float bits = residualBits(color.r - predicted.r);
+        if (channels >= 3)
+        {
+            bits += residualBits(color.g - predicted.g) + residualBits(color.b - predicted.b);
+        }
+        if (channels == 2 || channels == 4)
+        {
+            bits += residualBits(color.a - predicted.a);
+        }
+        return bits;
+    }
+
+    void fillLeaf(const QuadTreeNode* leaf, vector<vector<RGB>>& image)
+    {
+        const Rect& rect = leaf->getBounds();
+        const RGB color = leaf->getAvgColor();
+        for (int i = rect.y; i < rect.y + rect.height; ++i)
+        {
+            fillSpan(image[i].data() + rect.x, rect.width, color);
+        }
+    }
+
+    const int ACTIVE_LANES[5][4] = { {}, {0}, {0, 3}, {0, 1, 2}, {0, 1, 2, 3} };
+
+    // Per-lane squared error and area-weighted SSIM gathered by one worker
+    struct QualitySums
+    {
+        array<double, 4> sse{};
+        array<double, 4> ssim{};
+    };
+
+    // Sums of (pixel - color) and its square per lane over one row, taken
+    // just before the row is overwritten
+    void measureSpan(const RGB* src, int count, const RGB& color, array<double, 4>& sum, array<double, 4>& sumSq)
+    {
+#ifdef __SSE2__
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&color));
+        __m128d s01 = _mm_setzero_pd(), s23 = _mm_setzero_pd();
+        __m128d q01 = _mm_setzero_pd(), q23 = _mm_setzero_pd();
+        for (int i = 0; i < count; ++i)
+        {
+            __m128i d = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), c);
+            __m128d lo = _mm_cvtepi32_pd(d);
+            __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+            s01 = _mm_add_pd(s01, lo);
+            s23 = _mm_add_pd(s23, hi);
+            q01 = _mm_add_pd(q01, _mm_mul_pd(lo, lo));
+            q23 = _mm_add_pd(q23, _mm_mul_pd(hi, hi));
+        }
+        alignas(16) double out[8];
+        _mm_store_pd(out, s01);
+        _mm_store_pd(out + 2, s23);
+        _mm_store_pd(out + 4, q01);
+        _mm_store_pd(out + 6, q23);
+        for (int k = 0; k < 4; ++k)
+        {
+            sum[k] += out[k];
+            sumSq[k] += out[4 + k];
+        }
+#else
+        for (int i = 0; i < count; ++i)
+        {
+            const double d[4] = {
+                static_cast<double>(src[i].r - color.r), static_cast<double>(src[i].g - color.g),
+                static_cast<double>(src[i].b - color.b), static_cast<double>(src[i].a - color.a)
+            };
+            for (int k = 0; k < 4; ++k)
+            {
+                sum[k] += d[k];
+                sumSq[k] += d[k] * d[k];
+            }
+        }
+#endif
+    }
+
+    // source and output may be the same image: each row is measured before it is written
+    void fillLeafMeasured(const QuadTreeNode* leaf, const vector<vector<RGB>>& source, vector<vector<RGB>>& output, const ImageFormat& format, QualitySums& sums)
+    {
+        const Rect& rect = leaf->getBounds();
+        const RGB color = leaf->getAvgColor();
+        array<double, 4> sum{}, sumSq{};
+        for (int i = rect.y; i < rect.y + rect.height; ++i)
+        {
+            measureSpan(source[i].data() + rect.x, rect.width, color, sum, sumSq);
+            fillSpan(output[i].data() + rect.x, rect.width, color);
+        }
+
+        const double n = static_cast<double>(rect.width) * rect.height;
+        const int lanes[4] = {color.r, color.g, color.b, color.a};
+        for (int k = 0; k < format.channels; ++k)
+        {
+            int lane = ACTIVE_LANES[format.channels][k];
+            double offset = sum[lane] / n;
+            double variance = max(0.0, sumSq[lane] / n - offset * offset);
+            double muY = lanes[lane];
+            double muX = muY + offset;
+            sums.sse[lane] += sumSq[lane];
+            sums.ssim[lane] += n * ErrorMeasurement::computeFlatSSIM(muX, muY, variance, format.sampleMax);
+        }
+    }
+}
+
+QuadTreeNode::QuadTreeNode(): bounds{0, 0, 0, 0}, isLeaf(true), avgColor{0, 0, 0, 255}, splitError(0.0f)
 {
     childNode.fill(nullptr);
 } 
 
-QuadTreeNode::QuadTreeNode(int x, int y, int width, int height): bounds{x, y, width, height}, isLeaf(true), avgColor{0, 0, 0}
+QuadTreeNode::QuadTreeNode(int x, int y, int width, int height): bounds{x, y, width, height}, isLeaf(true), avgColor{0, 0, 0, 255}, splitError(0.0f)
 {
     childNode.fill(nullptr);
 }
@@ -23,6 +240,35 @@ QuadTreeNode::~QuadTreeNode()
     }
 }
 
+void* QuadTreeNode::operator new(size_t size)
+{
+    vector<void*>& blocks = nodeFreeList.blocks;
+    if (size == sizeof(QuadTreeNode) && !blocks.empty())
+    {
+        void* block = blocks.back();
+        blocks.pop_back();
+        return block;
+    }
+    return ::operator new(size);
+}
+
+void QuadTreeNode::operator delete(void* ptr, size_t size) noexcept
+{
+    vector<void*>& blocks = nodeFreeList.blocks;
+    if (ptr != nullptr && size == sizeof(QuadTreeNode) && blocks.size() < MAX_FREE_NODES)
+    {
+        try
+        {
+            blocks.push_back(ptr);
+            return;
+        }
+        catch (...)
+        {
+        }
+    }
+    ::operator delete(ptr);
+}
+
 const Rect& QuadTreeNode::getBounds() const noexcept
 {
     return bounds;
@@ -43,6 +289,11 @@ RGB QuadTreeNode::getAvgColor() const noexcept
     return avgColor;
 }
 
+float QuadTreeNode::getSplitError() const noexcept
+{
+    return splitError;
+}
+
 QuadTreeNode* QuadTreeNode::getChild(int idx) const noexcept
 {
     if (idx > 3 || idx < 0)
@@ -57,6 +308,11 @@ void QuadTreeNode::setAvgColor(RGB avgColor) noexcept
     this->avgColor = avgColor;
 }
 
+void QuadTreeNode::setSplitError(float error) noexcept
+{
+    splitError = error;
+}
+
 void QuadTreeNode::setLeaf(bool isLeaf) noexcept
 {
     this->isLeaf = isLeaf;
@@ -85,30 +341,40 @@ void QuadTreeNode::split()
     childNode[3] = new QuadTreeNode(bounds.x + midW, bounds.y + midH, bounds.width - midW, bounds.height - midH);
 }
 
-RGB QuadTreeNode::calculateAvgColor(const vector<vector<RGB>>& image) const
+void QuadTreeNode::splitAt(bool vertical, int position)
 {
-    long long sumR = 0, sumG = 0, sumB = 0;
-    int totalPixels = bounds.width * bounds.height;
+    setLeaf(false);
 
-    for (int i = bounds.y; i < bounds.y + bounds.height; ++i)
+    if (vertical)
     {
-        for (int j = bounds.x; j < bounds.x + bounds.width; ++j)
-        {
-            const RGB& pixel = image[i][j];
-            sumR += pixel.r;
-            sumG += pixel.g;
-            sumB += pixel.b;
-        }
+        childNode[0] = new QuadTreeNode(bounds.x, bounds.y, position, bounds.height);
+        childNode[1] = new QuadTreeNode(bounds.x + position, bounds.y, bounds.width - position, bounds.height);
     }
-    
-    return RGB{
-        static_cast<int>(sumR/totalPixels),
-        static_cast<int>(sumG/totalPixels),
-        static_cast<int>(sumB/totalPixels)
-    };
+    else
+    {
+        childNode[0] = new QuadTreeNode(bounds.x, bounds.y, bounds.width, position);
+        childNode[1] = new QuadTreeNode(bounds.x, bounds.y + position, bounds.width, bounds.height - position);
+    }
+    childNode[2] = nullptr;
+    childNode[3] = nullptr;
 }
 
-QuadTree::QuadTree() : root(nullptr), threshold(0), minSize(1) {}
+void QuadTreeNode::clearChildren()
+{
+    for (auto& child : childNode)
+    {
+        delete child;
+        child = nullptr;
+    }
+    setLeaf(true);
+}
+
+RGB QuadTreeNode::calculateAvgColor(const vector<vector<RGB>>& image, int channels) const
+{
+    return ErrorMeasurement::computeAvgColor(image, bounds.x, bounds.y, bounds.width, bounds.height, channels);
+}
+
+QuadTree::QuadTree() : root(nullptr), threshold(0.0f), minSize(1), method(Variance), format(), splitMode(QuadSplit), sampling(false), regionCount(0) {}
 
 QuadTree::~QuadTree()
 {
@@ -124,7 +390,7 @@ QuadTreeNode* QuadTree::getRoot() const noexcept
     return root;
 }
 
-int QuadTree::getThreshold() const noexcept
+float QuadTree::getThreshold() const noexcept
 {
     return threshold;
 }
@@ -134,6 +400,36 @@ int QuadTree::getMinSize() const noexcept
     return minSize;
 }
 
+SplitMode QuadTree::getSplitMode() const noexcept
+{
+    return splitMode;
+}
+
+ErrorMethod QuadTree::getMethod() const noexcept
+{
+    return method;
+}
+
+int QuadTree::getChannels() const noexcept
+{
+    return format.channels;
+}
+
+void QuadTree::setSampling(bool enabled) noexcept
+{
+    sampling = enabled;
+}
+
+const SamplingStats& QuadTree::getSamplingStats() const noexcept
+{
+    return samplingStats;
+}
+
+const ImageFormat& QuadTree::getFormat() const noexcept
+{
+    return format;
+}
+
 int QuadTree::getMaxDepth() const
 {
     return getMaxDepth(root);
@@ -160,7 +456,7 @@ int QuadTree::getMaxDepth(QuadTreeNode* node) const
 
 int QuadTree::getNodeCount() const
 {
-    getNodeCount(root);
+    return getNodeCount(root);
 }
 
 int QuadTree::getNodeCount(QuadTreeNode* node) const
@@ -178,83 +474,976 @@ int QuadTree::getNodeCount(QuadTreeNode* node) const
     return count;
 }
 
-float QuadTree::calculateError(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method)
+void QuadTree::collectLeaves(vector<QuadTreeNode*>& leaves) const
+{
+    leaves.clear();
+    if (!root)
+    {
+        return;
+    }
+
+    vector<QuadTreeNode*> stack{root};
+    while (!stack.empty())
+    {
+        QuadTreeNode* node = stack.back();
+        stack.pop_back();
+        if (node->isLeafNode())
+        {
+            leaves.push_back(node);
+            continue;
+        }
+        for (int i = 3; i >= 0; --i)
+        {
+            if (node->getChild(i) != nullptr)
+            {
+                stack.push_back(node->getChild(i));
+            }
+        }
+    }
+}
+
+void QuadTree::setLeafRegions(vector<int> regions, int count)
+{
+    leafRegions = move(regions);
+    regionCount = leafRegions.empty() ? 0 : count;
+}
+
+const vector<int>& QuadTree::getLeafRegions() const noexcept
+{
+    return leafRegions;
+}
+
+int QuadTree::getRegionCount() const noexcept
+{
+    return regionCount;
+}
+
+void QuadTree::dropRegions() noexcept
 {
+    leafRegions.clear();
+    regionCount = 0;
+}
+
+float QuadTree::calculateError(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, float bound)
+{
+    const int channels = format.channels;
+    const float limit = ErrorMeasurement::kernelLimit(method, bound, format.sampleMax);
+    float error = 0.0f;
+
     switch (method)
     {
     case 0:
-        return ErrorMeasurement::computeVariance(image, x, y, width, height);
+        error = ErrorMeasurement::computeVariance(image, x, y, width, height, channels);
+        break;
 
     case 1:
-        return ErrorMeasurement::computeMAD(image, x, y, width, height);
+        error = ErrorMeasurement::computeMAD(image, x, y, width, height, channels);
+        break;
 
     case 2:
-        return ErrorMeasurement::computeMaxPixelDiff(image, x, y, width, height);
+        error = ErrorMeasurement::computeMaxPixelDiff(image, x, y, width, height, channels, limit);
+        break;
 
     case 3:
-        return ErrorMeasurement::computeEntropy(image, x, y, width, height);
+        error = ErrorMeasurement::computeEntropy(image, x, y, width, height, channels, format.sampleMax);
+        break;
+
+    case 4:
+        error = ErrorMeasurement::computeLumaVariance(getIntegral(image, YCbCr).getMoments(x, y, width, height));
+        break;
+
+    case 5:
+        error = ErrorMeasurement::computeDeltaE(getIntegral(image, CIELab).getMoments(x, y, width, height));
+        break;
+
+    case 6:
+        error = ErrorMeasurement::computeSSIM(getIntegral(image, SRGB).getMoments(x, y, width, height), format.sampleMax);
+        break;
     
     default:
         return 0.0f;
     }
+
+    return ErrorMeasurement::normalizeError(method, error, format.sampleMax);
+}
+
+const IntegralImage& QuadTree::getIntegral(const vector<vector<RGB>>& image, ColorSpace space)
+{
+    if (!integral)
+    {
+        integral.reset(new IntegralImage());
+    }
+    if (integral->empty() || integral->getColorSpace() != space)
+    {
+        integral->build(image, space, format);
+    }
+    return *integral;
+}
+
+bool QuadTree::chooseSplit(const IntegralImage& stats, int x, int y, int width, int height, bool& vertical, int& position) const
+{
+    // Sum of squared deviations from the mean over all channels, O(1) from the
+    // tables. Gray is mirrored into three planes, so its alpha counts three times.
+    const int planes = stats.hasAlpha() ? 4 : 3;
+    const double alphaWeight = (format.channels == 2) ? 3.0 : 1.0;
+    auto cost = [&stats, planes, alphaWeight](int cx, int cy, int cw, int ch) -> double
+    {
+        double n = static_cast<double>(cw) * ch;
+        double sse = 0.0;
+        for (int c = 0; c < planes; ++c)
+        {
+            double s = stats.getSum(c, cx, cy, cw, ch);
+            sse += (stats.getSumSq(c, cx, cy, cw, ch) - s * s / n) * (c == 3 ? alphaWeight : 1.0);
+        }
+        return sse;
+    };
+
+    const int minPart = max(1, (minSize + 1) / 2);
+    double bestCost = -1.0;
+
+    if (width > minSize)
+    {
+        for (int p = minPart; p <= width - minPart; ++p)
+        {
+            double c = cost(x, y, p, height) + cost(x + p, y, width - p, height);
+            if (bestCost < 0 || c < bestCost)
+            {
+                bestCost = c;
+                vertical = true;
+                position = p;
+            }
+        }
+    }
+    if (height > minSize)
+    {
+        for (int p = minPart; p <= height - minPart; ++p)
+        {
+            double c = cost(x, y, width, p) + cost(x, y + p, width, height - p);
+            if (bestCost < 0 || c < bestCost)
+            {
+                bestCost = c;
+                vertical = false;
+                position = p;
+            }
+        }
+    }
+
+    return bestCost >= 0;
 }
 
-void QuadTree::buildTree(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, int threshold, int minSize)
+void QuadTree::buildTree(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, float threshold, int minSize, SplitMode splitMode, const ImageFormat& format)
 {
     this->threshold = threshold;
     this->minSize = minSize;
-    this->root = buildRecursive(image, x, y, width, height, method);
+    this->splitMode = splitMode;
+    this->method = method;
+    this->format = format;
+    dropRegions();
+
+    delete root;
+    root = nullptr;
+    rdCost.clear();
+    cellErrors.clear();
+    cellNumerators.clear();
+    samplingStats = SamplingStats();
+
+    // MaxPixelDiff and Variance read channel ranges and moments from the pyramid
+    // instead of rescanning every block
+    long long rootCell = -1;
+    if ((method == MaxPixelDiff || method == Variance) && splitMode == QuadSplit)
+    {
+        if (!pyramid)
+        {
+            pyramid.reset(new BlockPyramid());
+        }
+        pyramid->build(image, x, y, width, height, minSize, format.channels);
+        rootCell = pyramid->getRoot();
+    }
+    else if (pyramid)
+    {
+        pyramid->clear();
+    }
+
+    // Conversion planes belong to the previous image, rebuild lazily on first use
+    if (integral)
+    {
+        integral->clear();
+    }
+
+    this->root = buildRecursive(image, x, y, width, height, method, rootCell);
 }
 
-QuadTreeNode* QuadTree::buildRecursive(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method)
+QuadTreeNode* QuadTree::buildRecursive(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, long long cell)
 {
     QuadTreeNode* node = new QuadTreeNode(x, y, width, height);
-    float error = calculateError(image, x, y, width, height, method);
+    bool atMinSize = (splitMode == AdaptiveSplit)
+        ? (width <= minSize && height <= minSize)
+        : (width <= minSize || height <= minSize);
+
+    // A perfectly flat block has zero error under every method and its mean
+    // is its one color
+    RGB flat;
+    if (!atMinSize && checksFlat(cell) && ErrorMeasurement::isUniform(image, x, y, width, height, format.channels, flat))
+    {
+        node->setAvgColor(flat);
+        return node;
+    }
+
+    // Blocks at minimum size are leaves whatever their error, so they are not measured
+    bool homogeneous = atMinSize;
+    float measured = 0.0f;
+    if (!homogeneous)
+    {
+        homogeneous = belowThreshold(image, x, y, width, height, cell, &measured);
+    }
 
-    if (width <= minSize || height <= minSize || error < threshold)
+    if (homogeneous)
     {
-        RGB mean = node->calculateAvgColor(image);
+        RGB mean = (cell >= 0) ? pyramid->getAvgColor(cell) : node->calculateAvgColor(image, format.channels);
         node->setAvgColor(mean);
         return node;
     }
-    
-    node->split();
+    node->setSplitError(measured);
+
+    if (splitMode == AdaptiveSplit)
+    {
+        // Cut where the two halves have the least summed error
+        ColorSpace space = ErrorMeasurement::getColorSpace(method);
+        bool vertical = true;
+        int position = 0;
+        if (!chooseSplit(getIntegral(image, space), x, y, width, height, vertical, position))
+        {
+            node->setAvgColor(node->calculateAvgColor(image, format.channels));
+            return node;
+        }
+        node->splitAt(vertical, position);
+    }
+    else
+    {
+        node->split();
+    }
+
     for (int i = 0; i < 4; ++i)
     {
         QuadTreeNode* child = node->getChild(i);
-        node->setChild(i, buildRecursive(image, child->getBounds().x, child->getBounds().y, child->getBounds().width, child->getBounds().height, method));
+        if (child == nullptr)
+        {
+            continue;
+        }
+        const Rect b = child->getBounds();
+        long long childCell = (cell >= 0) ? pyramid->getChild(cell, i) : -1;
+        node->setChild(i, buildRecursive(image, b.x, b.y, b.width, b.height, method, childCell));
+        delete child;
     }
     
     return node;
 }
 
-void QuadTree::reconstructImage(vector<vector<RGB>>& image)
+bool QuadTree::belowThreshold(const vector<vector<RGB>>& image, int x, int y, int width, int height, long long cell, float* measured, float reach)
+{
+    float ignored;
+    float& error = measured ? *measured : ignored;
+    error = 0.0f;
+
+    if (sampling && cell < 0 && ErrorMeasurement::canSample(method, width, height))
+    {
+        const float limit = ErrorMeasurement::kernelLimit(method, threshold, format.sampleMax);
+        if (ErrorMeasurement::sampleReaches(method, image, x, y, width, height, format.channels, limit))
+        {
+            ++samplingStats.sampled;
+            samplingStats.expectedMistakes += ErrorMeasurement::sampleMissRate(method);
+            return false;
+        }
+        ++samplingStats.fallbacks;
+    }
+
+    if (method != Variance && method != MAD)
+    {
+        // An early-exit scan returns part of the error, still a lower bound
+        error = (cell >= 0) ? cellError(cell) : calculateError(image, x, y, width, height, method, threshold);
+        return error < threshold;
+    }
+
+    // Integer numerator against the threshold scaled to this block
+    const long long pixels = static_cast<long long>(width) * height;
+    const unsigned long long limit = ErrorMeasurement::numeratorLimit(method, threshold, format.sampleMax, format.channels, pixels);
+    const unsigned long long scanLimit = max(limit, ErrorMeasurement::numeratorLimit(method, reach, format.sampleMax, format.channels, pixels));
+    unsigned long long numerator;
+    if (method == Variance)
+    {
+        numerator = (cell >= 0) ? pyramid->getSquaredError(cell)
+                                : ErrorMeasurement::varianceNumerator(image, x, y, width, height, format.channels, scanLimit);
+    }
+    else
+    {
+        // MAD needs the block mean before its scan. Adaptive split already
+        // keeps sRGB sums for chooseSplit, so take it from there; otherwise
+        // the kernel finds it itself.
+        RGB mean;
+        const RGB* known = nullptr;
+        if (splitMode == AdaptiveSplit)
+        {
+            const IntegralImage& sums = getIntegral(image, SRGB);
+            int lanes[4] = {0, 0, 0, format.sampleMax};
+            for (int c = 0; c < (sums.hasAlpha() ? 4 : 3); ++c)
+            {
+                lanes[c] = static_cast<int>(static_cast<long long>(sums.getSum(c, x, y, width, height)) / pixels);
+            }
+            mean = RGB{lanes[0], lanes[1], lanes[2], lanes[3]};
+            known = &mean;
+        }
+        numerator = ErrorMeasurement::madNumerator(image, x, y, width, height, format.channels, scanLimit, known);
+    }
+
+    // Kernels that stop early return no more than the full numerator
+    error = numeratorError(method, numerator, format, pixels);
+    return numerator < limit;
+}
+
+bool QuadTree::checksFlat(long long cell) const noexcept
+{
+    // Pyramid cells and the integral-image methods already answer in O(1),
+    // where a flat-block scan would only add a pass over the block
+    const bool fromTables = (method == LumaVariance || method == DeltaE || method == SSIM);
+    return cell < 0 && !fromTables && threshold > 0.0f;
+}
+
+float QuadTree::cellError(long long cell) const
+{
+    float error = (method == MaxPixelDiff) ? pyramid->getMaxPixelDiff(cell) : pyramid->getVariance(cell);
+    return ErrorMeasurement::normalizeError(method, error, format.sampleMax);
+}
+
+void QuadTree::prepareCells(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, const ImageFormat& format)
+{
+    this->minSize = minSize;
+    this->splitMode = QuadSplit;
+    this->format = format;
+
+    delete root;
+    root = nullptr;
+    dropRegions();
+    if (integral)
+    {
+        integral->clear();
+    }
+
+    // The pyramid already is the full tree down to minSize, or to
+    // BlockPyramid::MAX_DEPTH on very large images, where the cells at the cap
+    // are the finest blocks the search can choose
+    if (!pyramid)
+    {
+        pyramid.reset(new BlockPyramid());
+    }
+    pyramid->build(image, x, y, width, height, minSize, format.channels);
+
+    const long long cells = pyramid->size();
+    cellDistortion.resize(cells);
+    cellBits.resize(cells);
+    cellSSIM.resize(cells);
+    rdCost.resize(cells);
+    cellSplit.assign(cells, 0);
+    cellErrors.clear();
+    cellNumerators.clear();
+
+    const int mid = (format.sampleMax + 1) / 2;
+    vector<RGB> predicted(cells);
+    predicted[0] = RGB{mid, mid, mid, format.sampleMax};
+    for (long long c = 0; c < cells; ++c)
+    {
+        RGB mean = pyramid->getAvgColor(c);
+        bool splittable = pyramid->getChild(c, 0) >= 0;
+        cellDistortion[c] = pyramid->getSquaredError(c);
+        cellBits[c] = (splittable ? SPLIT_FLAG_BITS : 0.0f) + colorBits(mean, predicted[c], format.channels);
+        for (int i = 0; splittable && i < 4; ++i)
+        {
+            predicted[pyramid->getChild(c, i)] = mean;
+        }
+
+        // Area-weighted SSIM of the block against its own flat color
+        const double n = static_cast<double>(pyramid->getCount(c));
+        const int lanes[4] = {mean.r, mean.g, mean.b, mean.a};
+        double ssim = 0.0;
+        for (int k = 0; k < format.channels; ++k)
+        {
+            int lane = ACTIVE_LANES[format.channels][k];
+            // The lane error is taken about the truncated mean; shift it to the true one
+            double muX = pyramid->getLaneSum(c, lane) / n;
+            double offset = muX - lanes[lane];
+            double variance = max(0.0, pyramid->getLaneSquaredError(c, lane) / n - offset * offset);
+            ssim += n * ErrorMeasurement::computeFlatSSIM(muX, lanes[lane], variance, format.sampleMax);
+        }
+        cellSSIM[c] = ssim;
+    }
+}
+
+void QuadTree::prepareRateDistortion(const vector<vector<RGB>>& image, int x, int y, int width, int height, int minSize, const ImageFormat& format)
+{
+    this->threshold = 0.0f;
+    this->method = Variance;
+    prepareCells(image, x, y, width, height, minSize, format);
+}
+
+void QuadTree::prepareThresholdSearch(const vector<vector<RGB>>& image, int x, int y, int width, int height, ErrorMethod method, int minSize, const ImageFormat& format)
+{
+    this->threshold = 0.0f;
+    this->method = method;
+    prepareCells(image, x, y, width, height, minSize, format);
+    cellErrors.assign(cellDistortion.size(), 0.0f);
+    cellNumerators.assign((method == Variance || method == MAD) ? cellDistortion.size() : 0, 0);
+    collectCellErrors(image, pyramid->getRoot(), x, y, width, height);
+}
+
+void QuadTree::collectCellErrors(const vector<vector<RGB>>& image, long long cell, int x, int y, int width, int height)
+{
+    // Blocks at minSize (or at the depth cap) are leaves whatever their error
+    if (pyramid->getChild(cell, 0) < 0)
+    {
+        return;
+    }
+    // The same values buildRecursive would compute for these blocks; Variance
+    // and MAD keep the numerator too, since their stop rule compares that
+    if (method == Variance || method == MAD)
+    {
+        const unsigned long long numerator = (method == Variance) ? pyramid->getSquaredError(cell)
+                                                                  : ErrorMeasurement::madNumerator(image, x, y, width, height, format.channels);
+        cellNumerators[cell] = numerator;
+        cellErrors[cell] = numeratorError(method, numerator, format, pyramid->getCount(cell));
+    }
+    else
+    {
+        cellErrors[cell] = (method == MaxPixelDiff) ? cellError(cell) : calculateError(image, x, y, width, height, method);
+    }
+
+    int midW = width/2;
+    int midH = height/2;
+    collectCellErrors(image, pyramid->getChild(cell, 0), x, y, midW, midH);
+    collectCellErrors(image, pyramid->getChild(cell, 1), x + midW, y, width - midW, midH);
+    collectCellErrors(image, pyramid->getChild(cell, 2), x, y + midH, midW, height - midH);
+    collectCellErrors(image, pyramid->getChild(cell, 3), x + midW, y + midH, width - midW, height - midH);
+}
+
+bool QuadTree::cellBelow(long long cell, float threshold) const
+{
+    if (method != Variance && method != MAD)
+    {
+        return cellErrors[cell] < threshold;
+    }
+    return cellNumerators[cell] < ErrorMeasurement::numeratorLimit(method, threshold, format.sampleMax, format.channels, pyramid->getCount(cell));
+}
+
+bool QuadTree::hasThresholdCache() const noexcept
+{
+    return pyramid && !pyramid->empty() && cellErrors.size() == static_cast<size_t>(pyramid->size());
+}
+
+void QuadTree::collectSplitErrors(vector<float>& errors) const
+{
+    errors.clear();
+    if (!hasThresholdCache())
+    {
+        return;
+    }
+    for (long long c = 0; c < pyramid->size(); ++c)
+    {
+        if (pyramid->getChild(c, 0) >= 0)
+        {
+            errors.push_back(cellErrors[c]);
+        }
+    }
+}
+
+QualityStats QuadTree::estimateQuality(float threshold) const
+{
+    QualityStats quality;
+    if (!hasThresholdCache())
+    {
+        return quality;
+    }
+
+    // Replays buildRecursive's stop rule over the cached errors, summing the
+    // stored distortion of every block that would become a leaf
+    double sse = 0.0, ssim = 0.0;
+    vector<long long> stack{pyramid->getRoot()};
+    while (!stack.empty())
+    {
+        long long c = stack.back();
+        stack.pop_back();
+        if (pyramid->getChild(c, 0) < 0 || cellBelow(c, threshold))
+        {
+            sse += cellDistortion[c];
+            ssim += cellSSIM[c];
+            continue;
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            stack.push_back(pyramid->getChild(c, i));
+        }
+    }
+
+    const double samples = static_cast<double>(pyramid->getCount(pyramid->getRoot())) * format.channels;
+    const double peak = static_cast<double>(format.sampleMax);
+    quality.mse = sse / samples;
+    quality.psnr = (quality.mse > 0.0) ? 10.0 * log10(peak * peak / quality.mse) : numeric_limits<double>::infinity();
+    quality.ssim = ssim / samples;
+    return quality;
+}
+
+void QuadTree::pruneThreshold(float threshold)
+{
+    if (!hasThresholdCache())
+    {
+        return;
+    }
+    this->threshold = threshold;
+    for (long long c = 0; c < pyramid->size(); ++c)
+    {
+        cellSplit[c] = pyramid->getChild(c, 0) >= 0 && !cellBelow(c, threshold);
+    }
+
+    delete root;
+    dropRegions();
+    RDCost total;
+    const Rect bounds = pyramid->getBounds();
+    root = buildFromCells(pyramid->getRoot(), bounds.x, bounds.y, bounds.width, bounds.height, total);
+}
+
+RDCost QuadTree::pruneRateDistortion(double lambda)
+{
+    RDCost total;
+    if (!pyramid || pyramid->empty() || rdCost.size() != static_cast<size_t>(pyramid->size()))
+    {
+        return total;
+    }
+
+    // Children always follow their parent, so a reverse sweep sees every
+    // subtree's best cost before the block that owns it
+    for (long long c = pyramid->size() - 1; c >= 0; --c)
+    {
+        double leafCost = cellDistortion[c] + lambda * cellBits[c];
+        if (pyramid->getChild(c, 0) < 0)
+        {
+            rdCost[c] = leafCost;
+            cellSplit[c] = 0;
+            continue;
+        }
+        double splitCost = lambda * SPLIT_FLAG_BITS;
+        for (int i = 0; i < 4; ++i)
+        {
+            splitCost += rdCost[pyramid->getChild(c, i)];
+        }
+        cellSplit[c] = splitCost < leafCost;
+        rdCost[c] = cellSplit[c] ? splitCost : leafCost;
+    }
+
+    delete root;
+    dropRegions();
+    const Rect bounds = pyramid->getBounds();
+    root = buildFromCells(pyramid->getRoot(), bounds.x, bounds.y, bounds.width, bounds.height, total);
+    return total;
+}
+
+QuadTreeNode* QuadTree::buildFromCells(long long cell, int x, int y, int width, int height, RDCost& total) const
+{
+    QuadTreeNode* node = new QuadTreeNode(x, y, width, height);
+    if (!cellSplit[cell])
+    {
+        node->setAvgColor(pyramid->getAvgColor(cell));
+        total.distortion += cellDistortion[cell];
+        total.bits += cellBits[cell];
+        return node;
+    }
+
+    // Same geometry as QuadTreeNode::split()
+    int midW = width/2;
+    int midH = height/2;
+    total.bits += SPLIT_FLAG_BITS;
+    node->setLeaf(false);
+    node->setChild(0, buildFromCells(pyramid->getChild(cell, 0), x, y, midW, midH, total));
+    node->setChild(1, buildFromCells(pyramid->getChild(cell, 1), x + midW, y, width - midW, midH, total));
+    node->setChild(2, buildFromCells(pyramid->getChild(cell, 2), x, y + midH, midW, height - midH, total));
+    node->setChild(3, buildFromCells(pyramid->getChild(cell, 3), x + midW, y + midH, width - midW, height - midH, total));
+    return node;
+}
+
+void QuadTree::update(const vector<vector<RGB>>& image, const Rect& dirtyRect)
 {
     if (!root)
     {
         return;
     }
-    reconstructRecursive(root, image);
+
+    const Rect& r = root->getBounds();
+    const int x0 = max(dirtyRect.x, r.x), y0 = max(dirtyRect.y, r.y);
+    const int x1 = min(dirtyRect.x + dirtyRect.width, r.x + r.width);
+    const int y1 = min(dirtyRect.y + dirtyRect.height, r.y + r.height);
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+    const Rect dirty{x0, y0, x1 - x0, y1 - y0};
+    dropRegions();
+
+    // Fold the edit into the caches; both only touch data overlapping the dirty rectangle
+    long long rootCell = -1;
+    if (pyramid && !pyramid->empty())
+    {
+        pyramid->update(image, dirty);
+        rootCell = pyramid->getRoot();
+    }
+    if (integral && !integral->empty())
+    {
+        integral->update(image, dirty);
+    }
+
+    root = updateRecursive(root, image, dirty, rootCell);
 }
 
-void QuadTree::reconstructRecursive(QuadTreeNode* node, vector<vector<RGB>>& image)
+bool QuadTree::staysSplit(QuadTreeNode* node, const Rect& dirty) const
 {
-    if (node->isLeafNode())
+    if (node->isLeafNode() || node->getSplitError() <= 0.0f)
     {
-        const Rect& rect = node->getBounds();
-        for (int i = rect.y; i < rect.y + rect.height; ++i)
+        return false;
+    }
+    const Rect& b = node->getBounds();
+    const int x0 = max(dirty.x, b.x), x1 = min(dirty.x + dirty.width, b.x + b.width);
+    const int y0 = max(dirty.y, b.y), y1 = min(dirty.y + dirty.height, b.y + b.height);
+    const double f = (static_cast<double>(x1 - x0) * (y1 - y0)) / (static_cast<double>(b.width) * b.height);
+    const double drop = editDrop(method, f);
+    if (drop < 0.0)
+    {
+        return false;
+    }
+
+    const double bound = node->getSplitError() - drop;
+    if (!(bound >= threshold))
+    {
+        return false;
+    }
+    // The recorded value must describe the edited image from now on
+    node->setSplitError(floorToFloat(bound));
+    return true;
+}
+
+QuadTreeNode* QuadTree::updateRecursive(QuadTreeNode* node, const vector<vector<RGB>>& image, const Rect& dirty, long long cell)
+{
+    const Rect b = node->getBounds();
+    if (dirty.x >= b.x + b.width || b.x >= dirty.x + dirty.width ||
+        dirty.y >= b.y + b.height || b.y >= dirty.y + dirty.height)
+    {
+        return node;
+    }
+
+    bool atMinSize = (splitMode == AdaptiveSplit)
+        ? (b.width <= minSize && b.height <= minSize)
+        : (b.width <= minSize || b.height <= minSize);
+
+    // A split node the edit cannot bring under the threshold goes straight to
+    // its children, so ancestors of a small edit are not rescanned
+    if (atMinSize || cell >= 0 || !staysSplit(node, dirty))
+    {
+        RGB flat;
+        if (!atMinSize && checksFlat(cell) && ErrorMeasurement::isUniform(image, b.x, b.y, b.width, b.height, format.channels, flat))
+        {
+            node->clearChildren();
+            node->setAvgColor(flat);
+            return node;
+        }
+
+        bool homogeneous = atMinSize;
+        float measured = 0.0f;
+        if (!homogeneous)
+        {
+            // Variance and MAD scan past the threshold so the recorded error
+            // has room to absorb the next edits without another scan
+            const float reach = (editDrop(method, 0.0) > 0.0) ? static_cast<float>(3.0 * threshold + 8.0 * editDrop(method, 0.0)) : 0.0f;
+            homogeneous = belowThreshold(image, b.x, b.y, b.width, b.height, cell, &measured, reach);
+        }
+
+        // Now homogeneous: collapse whatever was below
+        if (homogeneous)
+        {
+            node->clearChildren();
+            node->setAvgColor((cell >= 0) ? pyramid->getAvgColor(cell) : node->calculateAvgColor(image, format.channels));
+            return node;
+        }
+
+        // Was a leaf, now needs splitting: grow a fresh subtree here
+        if (node->isLeafNode())
+        {
+            QuadTreeNode* fresh = buildRecursive(image, b.x, b.y, b.width, b.height, method, cell);
+            delete node;
+            return fresh;
+        }
+        node->setSplitError(measured);
+    }
+
+    // The best cut depends on the whole block, so an edit anywhere in it can
+    // move it; the old subtree then no longer fits and is grown again
+    if (splitMode == AdaptiveSplit)
+    {
+        bool vertical = true;
+        int position = 0;
+        if (!chooseSplit(getIntegral(image, ErrorMeasurement::getColorSpace(method)), b.x, b.y, b.width, b.height, vertical, position))
+        {
+            node->clearChildren();
+            node->setAvgColor(node->calculateAvgColor(image, format.channels));
+            return node;
+        }
+        const Rect& first = node->getChild(0)->getBounds();
+        const bool wasVertical = first.width != b.width;
+        if (vertical != wasVertical || position != (wasVertical ? first.width : first.height))
+        {
+            QuadTreeNode* fresh = buildRecursive(image, b.x, b.y, b.width, b.height, method, cell);
+            delete node;
+            return fresh;
+        }
+    }
+
+    // Still split: only the children touching the edit can change
+    for (int i = 0; i < 4; ++i)
+    {
+        QuadTreeNode* child = node->getChild(i);
+        if (child != nullptr)
+        {
+            long long childCell = (cell >= 0) ? pyramid->getChild(cell, i) : -1;
+            node->setChild(i, updateRecursive(child, image, dirty, childCell));
+        }
+    }
+    return node;
+}
+
+int QuadTree::updateFromFrame(const vector<vector<RGB>>& previous, const vector<vector<RGB>>& current, vector<QuadTreeNode*>& rebuilt)
+{
+    rebuilt.clear();
+    if (!root)
+    {
+        return 0;
+    }
+    dropRegions();
+
+    // Both caches describe the previous frame; rebuilt subtrees fall back to direct kernels
+    if (pyramid)
+    {
+        pyramid->clear();
+    }
+    if (integral)
+    {
+        integral->clear();
+    }
+
+    root = refreshRecursive(root, previous, current, rebuilt);
+    return static_cast<int>(rebuilt.size());
+}
+
+bool QuadTree::keepsLeaf(const QuadTreeNode* leaf, const vector<vector<RGB>>& current)
+{
+    const Rect& b = leaf->getBounds();
+    const bool atMinSize = (splitMode == AdaptiveSplit)
+        ? (b.width <= minSize && b.height <= minSize)
+        : (b.width <= minSize || b.height <= minSize);
+    float error = 0.0f;
+    if (!atMinSize && !belowThreshold(current, b.x, b.y, b.width, b.height, -1, &error))
+    {
+        return false;
+    }
+
+    // Shift of the block mean away from the stored color, per native
+    // channel in 8-bit units
+    const RGB mean = leaf->calculateAvgColor(current, format.channels);
+    const RGB color = leaf->getAvgColor();
+    const int meanLanes[4] = {mean.r, mean.g, mean.b, mean.a};
+    const int colorLanes[4] = {color.r, color.g, color.b, color.a};
+    const double scale = 255.0 / format.sampleMax;
+    double sumAbs = 0.0, sumSq = 0.0, maxAbs = 0.0;
+    for (int k = 0; k < format.channels; ++k)
+    {
+        const int lane = ACTIVE_LANES[format.channels][k];
+        const double d = fabs(meanLanes[lane] - colorLanes[lane]) * scale;
+        sumAbs += d;
+        sumSq += d * d;
+        maxAbs = max(maxAbs, d);
+    }
+
+    // Below the threshold the measured error is exact. Variance about the
+    // stored color is the variance plus the squared shift, and MAD about it
+    // is at most the MAD plus the shift, so those keep the color while the
+    // leaf would still pass with it; MaxPixelDiff gets the MAD rule. The
+    // other methods do not see the color, and neither does a min-size leaf,
+    // so they allow only the rounding-level jitter of a noisy source.
+    if (!atMinSize && method == Variance)
+    {
+        return error + sumSq / format.channels < threshold;
+    }
+    if (!atMinSize && (method == MAD || method == MaxPixelDiff))
+    {
+        return error + sumAbs / format.channels < threshold;
+    }
+    return maxAbs <= 2.0;
+}
+
+QuadTreeNode* QuadTree::refreshRecursive(QuadTreeNode* node, const vector<vector<RGB>>& previous, const vector<vector<RGB>>& current, vector<QuadTreeNode*>& rebuilt)
+{
+    const Rect b = node->getBounds();
+
+    // Internal nodes are kept split and only their children are revisited.
+    // When that rebuilt some of them and all are leaves now, the node is
+    // measured again and may collapse into one leaf.
+    if (node->hasChildren())
+    {
+        const size_t first = rebuilt.size();
+        bool allLeaves = true;
+        for (int i = 0; i < 4; ++i)
         {
-            for (int j = rect.x; j < rect.x + rect.width; ++j)
+            QuadTreeNode* child = node->getChild(i);
+            if (child != nullptr)
             {
-                image[i][j] = node->getAvgColor();
+                child = refreshRecursive(child, previous, current, rebuilt);
+                node->setChild(i, child);
+                allLeaves = allLeaves && child->isLeafNode();
             }
         }
+        if (rebuilt.size() > first && allLeaves && belowThreshold(current, b.x, b.y, b.width, b.height))
+        {
+            // The rebuilt entries are children about to be freed
+            rebuilt.resize(first);
+            node->clearChildren();
+            node->setAvgColor(node->calculateAvgColor(current, format.channels));
+            rebuilt.push_back(node);
+        }
+        return node;
+    }
+
+    const size_t rowBytes = sizeof(RGB) * b.width;
+    bool changed = false;
+    for (int i = b.y; i < b.y + b.height && !changed; ++i)
+    {
+        changed = memcmp(&previous[i][b.x], &current[i][b.x], rowBytes) != 0;
+    }
+    if (!changed || keepsLeaf(node, current))
+    {
+        return node;
+    }
+
+    QuadTreeNode* fresh = buildRecursive(current, b.x, b.y, b.width, b.height, method);
+    delete node;
+    rebuilt.push_back(fresh);
+    return fresh;
+}
+
+void QuadTree::reconstructImage(vector<vector<RGB>>& image, QualityStats* quality)
+{
+    reconstructImage(image, image, quality);
+}
+
+void QuadTree::reconstructImage(const vector<vector<RGB>>& source, vector<vector<RGB>>& image, QualityStats* quality)
+{
+    if (!root)
+    {
+        return;
+    }
+
+    const Rect& bounds = root->getBounds();
+    if (&source != &image && (static_cast<int>(image.size()) != bounds.y + bounds.height
+                              || image.empty() || static_cast<int>(image[0].size()) != bounds.x + bounds.width))
+    {
+        image.assign(bounds.y + bounds.height, vector<RGB>(bounds.x + bounds.width));
+    }
+
+    vector<QuadTreeNode*> leaves;
+    collectLeaves(leaves);
+
+    // Leaves never overlap. Cut the Z-ordered leaf list into runs of roughly
+    // equal area, so that one huge leaf does not serialize a worker's share.
+    ThreadPool& pool = ThreadPool::shared();
+    const size_t runs = min(leaves.size(), static_cast<size_t>(pool.getThreadCount()) * 4);
+    long long totalArea = 0;
+    for (const QuadTreeNode* leaf : leaves)
+    {
+        totalArea += 1LL * leaf->getBounds().width * leaf->getBounds().height;
+    }
+
+    vector<size_t> cuts{0};
+    long long area = 0;
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+        area += 1LL * leaves[i]->getBounds().width * leaves[i]->getBounds().height;
+        if (area * static_cast<long long>(runs) >= totalArea * static_cast<long long>(cuts.size()) && i + 1 < leaves.size())
+        {
+            cuts.push_back(i + 1);
+        }
+    }
+    cuts.push_back(leaves.size());
+
+    if (quality == nullptr)
+    {
+        pool.parallelFor(0, cuts.size() - 1, 1, [&](size_t first, size_t last)
+        {
+            for (size_t run = first; run < last; ++run)
+            {
+                for (size_t i = cuts[run]; i < cuts[run + 1]; ++i)
+                {
+                    fillLeaf(leaves[i], image);
+                }
+            }
+#ifdef __SSE2__
+            _mm_sfence();
+#endif
+        });
+        return;
+    }
+
+    // One accumulator per run keeps the totals independent of scheduling
+    vector<QualitySums> partial(cuts.size() - 1);
+    pool.parallelFor(0, cuts.size() - 1, 1, [&](size_t first, size_t last)
+    {
+        for (size_t run = first; run < last; ++run)
+        {
+            for (size_t i = cuts[run]; i < cuts[run + 1]; ++i)
+            {
+                fillLeafMeasured(leaves[i], source, image, format, partial[run]);
+            }
+        }
+#ifdef __SSE2__
+        _mm_sfence();
+#endif
+    });
+
+    double sse = 0.0, ssim = 0.0;
+    for (const QualitySums& sums : partial)
+    {
+        for (int k = 0; k < format.channels; ++k)
+        {
+            int lane = ACTIVE_LANES[format.channels][k];
+            sse += sums.sse[lane];
+            ssim += sums.ssim[lane];
+        }
+    }
+
+    const double samples = static_cast<double>(totalArea) * format.channels;
+    const double peak = static_cast<double>(format.sampleMax);
+    quality->mse = sse / samples;
+    quality->psnr = (quality->mse > 0.0) ? 10.0 * log10(peak * peak / quality->mse) : numeric_limits<double>::infinity();
+    quality->ssim = ssim / samples;
+}
+
+void QuadTree::reconstructRecursive(QuadTreeNode* node, vector<vector<RGB>>& image)
+{
+    if (node->isLeafNode())
+    {
+        fillLeaf(node, image);
+#ifdef __SSE2__
+        _mm_sfence();
+#endif
     }
     else
     {
         for (int i = 0; i < 4; ++i)
         {
-            reconstructRecursive(node->getChild(i), image);
+            if (node->getChild(i) != nullptr)
+            {
+                reconstructRecursive(node->getChild(i), image);
+            }
         }
     }
 }
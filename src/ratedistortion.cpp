@@ -0,0 +1,122 @@
+#include "header/ratedistortion.hpp"
+#include "header/leafcoder.hpp"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <cstdint>
+
+namespace
+{
+    // lambda grows by this factor while bracketing the target
+    const double BRACKET_STEP = 4.0;
+    const int MAX_BRACKET_STEPS = 64;
+    const int MAX_BISECT_STEPS = 40;
+    // Stop bisecting once the bracket is this tight, relative to its upper end
+    const double LAMBDA_TOLERANCE = 1e-3;
+
+    size_t encodedSize(const QuadTree& tree)
+    {
+        vector<uint8_t> data;
+        return LeafCoder::encode(tree, data) ? data.size() : numeric_limits<size_t>::max();
+    }
+
+    // Prunes for lambda and reports whether the target holds there. Byte
+    // targets hold more easily as lambda grows, PSNR targets less easily.
+    bool probe(QuadTree& tree, const RateDistortion::Target& target, double lambda, RateDistortion::Result& result)
+    {
+        ++result.probes;
+        result.lambda = lambda;
+        result.cost = tree.pruneRateDistortion(lambda);
+        result.psnr = RateDistortion::psnr(tree, result.cost.distortion);
+        if (target.kind == RateDistortion::TargetBytes)
+        {
+            result.bytes = encodedSize(tree);
+            return static_cast<double>(result.bytes) <= target.value;
+        }
+        return result.psnr >= target.value;
+    }
+}
+
+double RateDistortion::psnr(const QuadTree& tree, double distortion)
+{
+    const QuadTreeNode* root = tree.getRoot();
+    if (root == nullptr)
+    {
+        return 0.0;
+    }
+    if (distortion <= 0.0)
+    {
+        return numeric_limits<double>::infinity();
+    }
+
+    const Rect& b = root->getBounds();
+    const ImageFormat& format = tree.getFormat();
+    double samples = static_cast<double>(b.width) * b.height * format.channels;
+    double peak = static_cast<double>(format.sampleMax);
+    return 10.0 * log10(peak * peak * samples / distortion);
+}
+
+bool RateDistortion::fit(QuadTree& tree, const Target& target, Result& result)
+{
+    result = Result();
+    if (target.kind == TargetLambda)
+    {
+        probe(tree, target, max(0.0, target.value), result);
+        result.bytes = encodedSize(tree);
+        return tree.getRoot() != nullptr;
+    }
+
+    // At lambda 0 the whole tree down to minSize is kept
+    const bool holdsAtZero = probe(tree, target, 0.0, result);
+    if (tree.getRoot() == nullptr)
+    {
+        return false;
+    }
+    if (target.kind == TargetBytes && holdsAtZero)
+    {
+        return true;
+    }
+    if (target.kind == TargetPSNR && !holdsAtZero)
+    {
+        result.bytes = encodedSize(tree);
+        return false;
+    }
+
+    // Grow lambda until the answer flips or the tree is a single leaf
+    double lo = 0.0;
+    double hi = 1.0;
+    int steps = 0;
+    while (probe(tree, target, hi, result) == holdsAtZero)
+    {
+        if (tree.getRoot()->isLeafNode() || ++steps >= MAX_BRACKET_STEPS)
+        {
+            // A PSNR target still holds with one leaf; a byte target never fits
+            result.bytes = encodedSize(tree);
+            return target.kind == TargetPSNR;
+        }
+        lo = hi;
+        hi *= BRACKET_STEP;
+    }
+
+    // Bisect in log space; the side where the target holds is kept
+    for (int i = 0; i < MAX_BISECT_STEPS && hi - lo > hi * LAMBDA_TOLERANCE; ++i)
+    {
+        double mid = (lo > 0.0) ? sqrt(lo * hi) : hi / 16.0;
+        if (probe(tree, target, mid, result) == holdsAtZero)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    probe(tree, target, (target.kind == TargetBytes) ? hi : lo, result);
+    if (target.kind != TargetBytes)
+    {
+        result.bytes = encodedSize(tree);
+    }
+    return true;
+}
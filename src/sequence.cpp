@@ -0,0 +1,244 @@
+#include "header/sequence.hpp"
+#include "header/cli.hpp"
+#include "header/leafcoder.hpp"
+#include "header/threadpool.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <iterator>
+
+namespace
+{
+    string framePath(const string& outputDir, int index, const string& extension)
+    {
+        ostringstream name;
+        name << "frame_" << setw(5) << setfill('0') << index << extension;
+        return (filesystem::path(outputDir) / name.str()).string();
+    }
+
+    bool writeFile(const string& path, const vector<uint8_t>& data)
+    {
+        ofstream out(path, ios::binary);
+        return static_cast<bool>(out.write(reinterpret_cast<const char*>(data.data()), data.size()));
+    }
+}
+
+bool Sequence::readFrameList(const string& listPath, vector<string>& frames)
+{
+    ifstream list(listPath);
+    if (!list)
+    {
+        return false;
+    }
+
+    frames.clear();
+    string line;
+    while (getline(list, line))
+    {
+        line = trim(line);
+        if (!line.empty() && line[0] != '#')
+        {
+            frames.push_back(line);
+        }
+    }
+    return !frames.empty();
+}
+
+int Sequence::runSequence(const vector<string>& frames, const string& outputDir, ErrorMethod method,
+                          float threshold, int minSize, SplitMode splitMode, int keyframeInterval)
+{
+    error_code ec;
+    filesystem::create_directories(outputDir, ec);
+
+    QuadTree qt;
+    vector<vector<RGB>> previous, current;
+    // What the decoder holds after each frame; deltas are predicted from it
+    vector<vector<RGB>> canvas;
+    vector<uint8_t> data;
+    vector<QuadTreeNode*> rebuilt;
+    int sinceKeyframe = 0;
+    ImageFormat format;
+
+    // The next batch of frames is decoded in the background, one file per
+    // pool worker, while the current batch is compressed
+    const size_t batchSize = min<size_t>(max(1u, ThreadPool::shared().getThreadCount()), 4);
+    auto loadBatch = [&frames, batchSize](size_t first, vector<vector<vector<RGB>>>& images, vector<ImageFormat>& formats)
+    {
+        const size_t last = min(frames.size(), first + batchSize);
+        processImages(vector<string>(frames.begin() + first, frames.begin() + last), images, formats);
+    };
+    vector<vector<vector<RGB>>> batch, nextBatch;
+    vector<ImageFormat> batchFormats, nextFormats;
+    future<void> pending = async(launch::async, loadBatch, 0, ref(nextBatch), ref(nextFormats));
+
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+        const size_t slot = f % batchSize;
+        if (slot == 0)
+        {
+            pending.get();
+            batch.swap(nextBatch);
+            batchFormats.swap(nextFormats);
+            if (f + batchSize < frames.size())
+            {
+                pending = async(launch::async, loadBatch, f + batchSize, ref(nextBatch), ref(nextFormats));
+            }
+        }
+        current.swap(batch[slot]);
+        batch[slot].clear();
+        if (current.empty())
+        {
+            cerr << "Frame dilewati: " << frames[f] << '\n';
+            continue;
+        }
+        const ImageFormat& frameFormat = batchFormats[slot];
+        bool formatChanged = format.channels != frameFormat.channels || format.sampleMax != frameFormat.sampleMax
+            || format.hdrScale != frameFormat.hdrScale;
+        format = frameFormat;
+
+        auto start = chrono::high_resolution_clock::now();
+        const int width = static_cast<int>(current[0].size());
+        const int height = static_cast<int>(current.size());
+
+        bool keyframe = previous.empty() || formatChanged
+            || previous.size() != current.size() || previous[0].size() != current[0].size()
+            || (keyframeInterval > 0 && sinceKeyframe >= keyframeInterval);
+
+        if (keyframe)
+        {
+            qt.buildTree(current, 0, 0, width, height, method, threshold, minSize, splitMode, format);
+            rebuilt.assign(1, qt.getRoot());
+            sinceKeyframe = 0;
+        }
+        else
+        {
+            qt.updateFromFrame(previous, current, rebuilt);
+        }
+        string error;
+        if (!LeafCoder::encodeFrame(qt, rebuilt, keyframe, canvas, data, &error)
+            || !writeFile(framePath(outputDir, static_cast<int>(f), ".qtd"), data))
+        {
+            cerr << "Gagal menulis frame " << f << (error.empty() ? "" : ": " + error) << '\n';
+        }
+        ++sinceKeyframe;
+
+        auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start);
+        if (keyframe)
+        {
+            cout << "Frame " << f << " (keyframe)          : " << qt.getNodeCount() << " simpul, " << data.size() << " byte, "
+                 << duration.count() << " ms\n";
+        }
+        else
+        {
+            long long changedArea = 0;
+            for (const QuadTreeNode* subtree : rebuilt)
+            {
+                changedArea += 1LL * subtree->getBounds().width * subtree->getBounds().height;
+            }
+            cout << "Frame " << f << " (delta)             : " << rebuilt.size() << " subtree berubah, "
+                 << fixed << setprecision(2) << (100.0 * changedArea / (1.0 * width * height)) << "% area, "
+                 << data.size() << " byte, " << duration.count() << " ms\n";
+            cout.unsetf(ios::floatfield);
+        }
+
+        previous.swap(current);
+    }
+
+    return 0;
+}
+
+int Sequence::sequenceHandler(int argc, char* argv[])
+{
+    if (argc < 7)
+    {
+        cerr << "Penggunaan: " << argv[0] << " --sequence <daftar_frame.txt> <folder_output> <metode> <threshold> <ukuran_blok_min> [interval_keyframe]\n";
+        return EXIT_FAILURE;
+    }
+
+    vector<string> frames;
+    if (!readFrameList(argv[2], frames))
+    {
+        cerr << "Daftar frame tidak dapat dibaca atau kosong: " << argv[2] << '\n';
+        return EXIT_FAILURE;
+    }
+
+    string methodStr = argv[4];
+    transform(methodStr.begin(), methodStr.end(), methodStr.begin(), ::tolower);
+    ErrorMethod method;
+    if (!parseErrorMethod(methodStr, method))
+    {
+        cerr << "Metode error tidak dikenali: " << argv[4] << '\n';
+        return EXIT_FAILURE;
+    }
+
+    float threshold = 0.0f;
+    int minSize = 0, keyframeInterval = 0;
+    if (!(stringstream(argv[5]) >> threshold) || !isValidThreshold(method, threshold))
+    {
+        cerr << "Threshold tidak valid: " << argv[5] << '\n';
+        return EXIT_FAILURE;
+    }
+    if (!(stringstream(argv[6]) >> minSize) || minSize <= 1)
+    {
+        cerr << "Ukuran blok minimum harus bilangan bulat > 1\n";
+        return EXIT_FAILURE;
+    }
+    if (argc > 7 && (!(stringstream(argv[7]) >> keyframeInterval) || keyframeInterval < 0))
+    {
+        cerr << "Interval keyframe harus bilangan bulat >= 0\n";
+        return EXIT_FAILURE;
+    }
+
+    return runSequence(frames, argv[3], method, threshold, minSize, QuadSplit, keyframeInterval);
+}
+
+int Sequence::decodeSequence(const string& inputDir, const string& outputDir)
+{
+    vector<string> frames;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(inputDir, ec))
+    {
+        const string name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.compare(0, 6, "frame_") == 0 && hasExtension(name, ".qtd"))
+        {
+            frames.push_back(name);
+        }
+    }
+    if (ec || frames.empty())
+    {
+        cerr << "Tidak ada frame .qtd di folder: " << inputDir << '\n';
+        return EXIT_FAILURE;
+    }
+    // Zero-padded indices, so name order is frame order
+    sort(frames.begin(), frames.end());
+    filesystem::create_directories(outputDir, ec);
+
+    vector<vector<RGB>> canvas;
+    ImageFormat format;
+    auto start = chrono::high_resolution_clock::now();
+    for (const string& name : frames)
+    {
+        ifstream file((filesystem::path(inputDir) / name).string(), ios::binary);
+        vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string error;
+        if (!LeafCoder::decodeFrame(data, canvas, format, &error))
+        {
+            cerr << "Gagal: " << name << ": " << error << '\n';
+            return EXIT_FAILURE;
+        }
+        const string output = (filesystem::path(outputDir) / filesystem::path(name).replace_extension(".png")).string();
+        if (!writeImage(canvas, output, format))
+        {
+            cerr << "Gagal menyimpan frame ke: " << output << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+    auto duration = chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start);
+    cout << frames.size() << " frame didekode ke " << outputDir << " dalam " << duration.count() << " ms\n";
+    return 0;
+}
@@ -0,0 +1,5 @@
+// Single translation unit holding the stb image implementations
+#define STB_IMAGE_IMPLEMENTATION
+#include "header/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "header/stb_image_write.h"
@@ -0,0 +1,116 @@
+#include "header/threadpool.hpp"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) : stopping(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+
+    // The caller of parallelFor is one of the threads doing the work
+    for (unsigned i = 1; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+            {
+                return;
+            }
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+unsigned ThreadPool::getThreadCount() const noexcept
+{
+    return static_cast<unsigned>(workers.size()) + 1;
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const function<void(size_t, size_t)>& body)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    grain = max<size_t>(1, grain);
+    const size_t chunkCount = (end - begin + grain - 1) / grain;
+    if (workers.empty() || chunkCount == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    struct Job
+    {
+        atomic<size_t> next{0};
+        atomic<size_t> finished{0};
+        mutex doneMutex;
+        condition_variable done;
+    };
+    auto job = make_shared<Job>();
+
+    // Grab chunks until none are left; shared by the caller and the helpers
+    auto run = [job, begin, end, grain, chunkCount, &body]()
+    {
+        size_t chunk;
+        while ((chunk = job->next.fetch_add(1)) < chunkCount)
+        {
+            size_t lo = begin + chunk * grain;
+            body(lo, min(end, lo + grain));
+            if (job->finished.fetch_add(1) + 1 == chunkCount)
+            {
+                lock_guard<mutex> lock(job->doneMutex);
+                job->done.notify_all();
+            }
+        }
+    };
+
+    const size_t helpers = min(workers.size(), chunkCount - 1);
+    {
+        lock_guard<mutex> lock(queueMutex);
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            tasks.emplace_back(run);
+        }
+    }
+    queueReady.notify_all();
+
+    run();
+
+    unique_lock<mutex> lock(job->doneMutex);
+    job->done.wait(lock, [&job, chunkCount] { return job->finished.load() == chunkCount; });
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,68 @@
+#include "header/thresholdsearch.hpp"
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    // Candidate k keeps every block whose error is at least sorted[k] split
+    // and makes the rest leaves. It sits midway between neighbouring errors
+    // so a printed, rounded threshold still selects the same tree.
+    float candidate(const vector<float>& sorted, size_t k)
+    {
+        if (k == 0)
+        {
+            return sorted.empty() ? 0.0f : max(0.0f, sorted[0] / 2.0f);
+        }
+        if (k < sorted.size())
+        {
+            return (sorted[k - 1] + sorted[k]) / 2.0f;
+        }
+        float last = sorted.back();
+        return max(last + 1.0f, last * 1.001f);
+    }
+
+    bool holds(const QualityStats& quality, ThresholdSearch::Metric metric, double target)
+    {
+        return (metric == ThresholdSearch::TargetPSNR) ? quality.psnr >= target : quality.ssim >= target;
+    }
+}
+
+bool ThresholdSearch::fit(QuadTree& tree, Metric metric, double target, Result& result)
+{
+    result = Result();
+    vector<float> errors;
+    tree.collectSplitErrors(errors);
+    sort(errors.begin(), errors.end());
+    errors.erase(unique(errors.begin(), errors.end()), errors.end());
+
+    // Quality only drops as the threshold grows, so bisect for the last
+    // candidate that still holds
+    size_t lo = 0;
+    size_t hi = errors.size();
+    ++result.probes;
+    if (!holds(tree.estimateQuality(candidate(errors, lo)), metric, target))
+    {
+        result.threshold = candidate(errors, lo);
+        result.quality = tree.estimateQuality(result.threshold);
+        tree.pruneThreshold(result.threshold);
+        return false;
+    }
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        ++result.probes;
+        if (holds(tree.estimateQuality(candidate(errors, mid)), metric, target))
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    result.threshold = candidate(errors, lo);
+    result.quality = tree.estimateQuality(result.threshold);
+    tree.pruneThreshold(result.threshold);
+    return true;
+}
@@ -1,8 +1,9 @@
-#define STB_IMAGE_IMPLEMENTATION
-#include "header/stb_image.h" 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "header/stb_image_write.h" 
+#include "header/stb_image.h"
+#include "header/stb_image_write.h"
 #include "header/utils.hpp"
+#include "header/threadpool.hpp"
+#include "header/pngwriter.hpp"
+#include "header/qoi.hpp"
 #include <cmath>
 #include <algorithm>
 #include <unordered_map>
@@ -12,9 +13,15 @@
 #include <cstdlib>
 #include <string>
 #include <cctype>
+#include <climits>
 
 using namespace std;
 
+// Quality passed to stbi_write_jpg for .jpg/.jpeg output
+const int JPEG_QUALITY = 90;
+// JPEG stores its dimensions in 16 bits
+const int MAX_JPEG_DIMENSION = 65535;
+
 const unordered_map<string, ErrorMethod> errorMethodMap = {
     {"variance", Variance},
     {"mad", MAD},
@@ -22,6 +29,11 @@ const unordered_map<string, ErrorMethod> errorMethodMap = {
     {"max pixel difference", MaxPixelDiff},
     {"mpd", MaxPixelDiff},
     {"entropy", Entropy},
+    {"luma variance", LumaVariance},
+    {"ycbcr", LumaVariance},
+    {"delta e", DeltaE},
+    {"deltae", DeltaE},
+    {"ssim", SSIM},
 };
 
 bool fileExists(const string& filename)
@@ -31,7 +43,7 @@ bool fileExists(const string& filename)
 }
 
 bool hasValidExtension(const string& filename) {
-    static const vector<string> validExtensions = {".jpg", ".jpeg", ".png", ".bmp"};
+    static const vector<string> validExtensions = {".jpg", ".jpeg", ".png", ".bmp", ".hdr", ".qoi"};
     auto pos = filename.find_last_of('.');
     if (pos == string::npos) return false;
 
@@ -41,23 +53,31 @@ bool hasValidExtension(const string& filename) {
     return find(validExtensions.begin(), validExtensions.end(), ext) != validExtensions.end();
 }
 
+bool hasExtension(const string& path, const string& ext)
+{
+    if (path.size() < ext.size())
+    {
+        return false;
+    }
+    string tail = path.substr(path.size() - ext.size());
+    transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+    return tail == ext;
+}
+
 bool isValidErrorMethod(const string& errorMethodStr)
 {
     return errorMethodMap.find(errorMethodStr) != errorMethodMap.end();
 }
 
-ErrorMethod parseErrorMethod(const string& errorMethodStr)
+bool parseErrorMethod(const string& errorMethodStr, ErrorMethod& method)
 {
     auto it = errorMethodMap.find(errorMethodStr);
-    if (it != errorMethodMap.end())
+    if (it == errorMethodMap.end())
     {
-        return it->second;
-    }
-    else
-    {
-        cerr << "Metode error tidak dikenali: " << errorMethodStr << std::endl;
-        exit(1);
+        return false;
     }
+    method = it->second;
+    return true;
 }
 
 bool isValidThreshold(ErrorMethod method, float threshold)
@@ -78,9 +98,20 @@ bool isValidThreshold(ErrorMethod method, float threshold)
     {
         return threshold >= 0 && threshold <= 8.0f;
     }
+    else if (method == LumaVariance)
+    {
+        return threshold > 0 && threshold <= 65025.0f;
+    }
+    else if (method == DeltaE)
+    {
+        return threshold > 0 && threshold <= 200.0f;
+    }
+    else if (method == SSIM)
+    {
+        return threshold >= 0 && threshold <= 1.0f;
+    }
     else
     {
-        cerr << "Threshold is not in valid range." << endl;
         return false;
     }
 }
@@ -92,208 +123,361 @@ string trim(const string& s)
     return (start == string::npos) ? "" : s.substr(start, end - start + 1);
 }
 
-string getNonEmptyLine(const string& prompt)
-{
-    string input;
-    do {
-        cout << prompt;
-        getline(cin, input);
-        input = trim(input);
-    } while (input.empty());
-    return input;
-}
-
-bool processImage(const string& imagePath, vector<vector<RGB>>& image)
+namespace
 {
-    int width, height, channels;
-    unsigned char* data = stbi_load(imagePath.c_str(), &width, &height, &channels, 3); // force 3 channels (RGB)
-    
-    if (!data) {
-        cerr << "Gagal memuat gambar: " << imagePath << endl;
-        return false;
+    // Widening copy of packed 8-bit or 16-bit samples into RGB structs, one
+    // variant per native channel count; straight-line loops over raw pointers,
+    // left for the compiler to vectorize. Gray is mirrored into r, g and b.
+    template <int Channels, typename Sample>
+    void unpackRow(const Sample* src, RGB* dst, int width, int opaque)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const Sample* p = src + Channels * x;
+            if (Channels <= 2)
+            {
+                dst[x].r = dst[x].g = dst[x].b = p[0];
+            }
+            else
+            {
+                dst[x].r = p[0];
+                dst[x].g = p[1 % Channels];
+                dst[x].b = p[2 % Channels];
+            }
+            dst[x].a = (Channels == 2 || Channels == 4) ? p[Channels - 1] : opaque;
+        }
     }
 
-    image.resize(height, vector<RGB>(width));
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            int index = (y * width + x) * 3;
-            image[y][x] = {
-                data[index],     // R
-                data[index + 1], // G
-                data[index + 2]  // B
-            };
+    // Narrowing copy back to packed samples; Bytes = 2 writes big-endian as PNG expects
+    template <int Bytes>
+    void putSample(unsigned char* dst, int v)
+    {
+        if (Bytes == 2)
+        {
+            dst[0] = static_cast<uint8_t>(v >> 8);
+            dst[1] = static_cast<uint8_t>(v);
+        }
+        else
+        {
+            dst[0] = static_cast<uint8_t>(v);
         }
     }
 
-    stbi_image_free(data);
-    return true;
-}
-
-long long getFileSize(const string& path)
-{
-    ifstream file(path, ios::binary | ios::ate);
-    if (!file) return -1;
-    return static_cast<long long>(file.tellg());
-}
-
-void inputHandler(string& inputImagePath, vector<vector<RGB>>& image,
-                  string& errorMethodStr, ErrorMethod& method, float& threshold,
-                  int& minBlockSize, string& outputImagePath)
-{
-    // Input path
-    cout << "Masukkan path gambar input (dengan ekstensi)\n";
-    cout << "Ekstensi valid: .png, .jpg, .jpeg, .bmp\n\n";
+    template <int Channels, int Bytes>
+    void packRow(const RGB* src, unsigned char* dst, int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            unsigned char* p = dst + Channels * Bytes * x;
+            putSample<Bytes>(p, src[x].r);
+            if (Channels >= 3)
+            {
+                putSample<Bytes>(p + (1 % Channels) * Bytes, src[x].g);
+                putSample<Bytes>(p + (2 % Channels) * Bytes, src[x].b);
+            }
+            if (Channels == 2 || Channels == 4)
+            {
+                putSample<Bytes>(p + (Channels - 1) * Bytes, src[x].a);
+            }
+        }
+    }
 
-    while (true) {
-        inputImagePath = getNonEmptyLine("Path gambar input: ");
-        if (!fileExists(inputImagePath))
+    template <int Bytes>
+    void packRows(const vector<vector<RGB>>& image, int channels, vector<uint8_t>& data)
+    {
+        const int height = static_cast<int>(image.size());
+        const int width = static_cast<int>(image[0].size());
+        const size_t rowBytes = static_cast<size_t>(width) * channels * Bytes;
+        data.resize(rowBytes * height);
+        for (int y = 0; y < height; ++y)
         {
-            cout << "File tidak ditemukan.\n\n";
+            uint8_t* dst = data.data() + y * rowBytes;
+            switch (channels)
+            {
+            case 1: packRow<1, Bytes>(image[y].data(), dst, width); break;
+            case 2: packRow<2, Bytes>(image[y].data(), dst, width); break;
+            case 4: packRow<4, Bytes>(image[y].data(), dst, width); break;
+            default: packRow<3, Bytes>(image[y].data(), dst, width); break;
+            }
         }
-        else if (!hasValidExtension(inputImagePath))
+    }
+
+    // 8-bit samples for the codecs that only take 8 bits; deeper samples keep
+    // their high byte
+    void packRows8(const vector<vector<RGB>>& image, int channels, int sampleMax, vector<uint8_t>& data)
+    {
+        if (sampleMax <= 255)
         {
-            cout << "Ekstensi file tidak valid. Gunakan salah satu dari: .png, .jpg, .jpeg, .bmp\n\n";
+            packRows<1>(image, channels, data);
+            return;
         }
-        else
+        packRows<2>(image, channels, data);
+        const size_t count = data.size() / 2;
+        for (size_t i = 0; i < count; ++i)
         {
-            break;
+            data[i] = data[2 * i];
         }
+        data.resize(count);
     }
-    cout << endl;
-
-    // Output path
-    cout << "Masukkan path gambar output (dengan ekstensi)\n";
-    cout << "Ekstensi valid: .png, .jpg, .jpeg, .bmp\n";
-    cout << "Path output tidak boleh sama dengan path input\n\n";
 
-    while (true) {
-        outputImagePath = getNonEmptyLine("Path gambar output: ");
+    template <typename Sample>
+    void unpackImage(const Sample* data, int width, int height, int channels, int opaque, vector<vector<RGB>>& image)
+    {
+        // Rows are allocated and filled by the worker that converts them; rows
+        // of a previous image are reused, keeping their capacity
+        image.resize(height);
+        const size_t rowSamples = static_cast<size_t>(width) * channels;
+        ThreadPool::shared().parallelFor(0, height, 64, [&](size_t first, size_t last)
+        {
+            for (size_t y = first; y < last; ++y)
+            {
+                image[y].resize(width);
+                const Sample* src = data + y * rowSamples;
+                switch (channels)
+                {
+                case 1: unpackRow<1>(src, image[y].data(), width, opaque); break;
+                case 2: unpackRow<2>(src, image[y].data(), width, opaque); break;
+                case 4: unpackRow<4>(src, image[y].data(), width, opaque); break;
+                default: unpackRow<3>(src, image[y].data(), width, opaque); break;
+                }
+            }
+        });
+    }
 
-        if (!hasValidExtension(outputImagePath))
+    // Radiance is scaled so the brightest sample of the image maps to 65535;
+    // the factor is kept in the format so .hdr output can undo it.
+    vector<uint16_t> quantizeHdr(const float* data, size_t count, int channels, float& scale)
+    {
+        const bool hasAlpha = (channels == 2 || channels == 4);
+        float peak = 0.0f;
+        for (size_t i = 0; i < count; ++i)
         {
-            cout << "\nEkstensi tidak valid. Gunakan salah satu dari: .png, .jpg, .jpeg, .bmp\n\n";
-            continue;
+            if (!(hasAlpha && i % channels == static_cast<size_t>(channels - 1)))
+            {
+                peak = max(peak, data[i]);
+            }
         }
+        scale = (peak > 0.0f) ? 65535.0f / peak : 1.0f;
 
-        if (outputImagePath == inputImagePath)
+        vector<uint16_t> samples(count);
+        for (size_t i = 0; i < count; ++i)
         {
-            cout << "\nPath output tidak boleh sama dengan path input.\n\n";
-            continue;
+            bool alpha = hasAlpha && i % channels == static_cast<size_t>(channels - 1);
+            float v = alpha ? data[i] * 65535.0f : data[i] * scale;
+            samples[i] = static_cast<uint16_t>(lroundf(min(max(v, 0.0f), 65535.0f)));
         }
+        return samples;
+    }
+}
+
+namespace
+{
+    // stb entry points for decoding from a file path
+    struct FileSource
+    {
+        const char* path;
+
+        bool isHdr() const { return stbi_is_hdr(path) != 0; }
+        bool is16Bit() const { return stbi_is_16_bit(path) != 0; }
+        float* loadFloat(int* w, int* h, int* c) const { return stbi_loadf(path, w, h, c, 0); }
+        stbi_us* load16(int* w, int* h, int* c) const { return stbi_load_16(path, w, h, c, 0); }
+        stbi_uc* load8(int* w, int* h, int* c) const { return stbi_load(path, w, h, c, 0); }
+    };
+
+    // stb entry points for decoding an encoded file held in memory
+    struct MemorySource
+    {
+        const stbi_uc* bytes;
+        int size;
+
+        bool isHdr() const { return stbi_is_hdr_from_memory(bytes, size) != 0; }
+        bool is16Bit() const { return stbi_is_16_bit_from_memory(bytes, size) != 0; }
+        float* loadFloat(int* w, int* h, int* c) const { return stbi_loadf_from_memory(bytes, size, w, h, c, 0); }
+        stbi_us* load16(int* w, int* h, int* c) const { return stbi_load_16_from_memory(bytes, size, w, h, c, 0); }
+        stbi_uc* load8(int* w, int* h, int* c) const { return stbi_load_from_memory(bytes, size, w, h, c, 0); }
+    };
+
+    template <class Source>
+    bool decodeImage(const Source& source, vector<vector<RGB>>& image, ImageFormat& format)
+    {
+        int width, height, channels;
+        format = ImageFormat();
 
-        if (fileExists(outputImagePath))
+        if (source.isHdr())
         {
-            cout << "\nFile sudah ada. Timpa? (y/n): ";
-            string response;
-            getline(cin, response);
-            if (!response.empty() && tolower(response[0]) == 'y') break;
+            float* data = source.loadFloat(&width, &height, &channels);
+            if (!data) {
+                return false;
+            }
+            vector<uint16_t> samples = quantizeHdr(data, static_cast<size_t>(width) * height * channels, channels, format.hdrScale);
+            stbi_image_free(data);
+            format.sampleMax = 65535;
+            format.channels = channels;
+            unpackImage(samples.data(), width, height, channels, format.sampleMax, image);
+            return true;
         }
-        else
+
+        if (source.is16Bit())
         {
-            break;
+            stbi_us* data = source.load16(&width, &height, &channels);
+            if (!data) {
+                return false;
+            }
+            format.sampleMax = 65535;
+            format.channels = channels;
+            unpackImage(data, width, height, channels, format.sampleMax, image);
+            stbi_image_free(data);
+            return true;
         }
-    }
 
-    cout << endl;
+        stbi_uc* data = source.load8(&width, &height, &channels); // native channel count
+        if (!data) {
+            return false;
+        }
 
-    // Metode error
-    cout << "Pilih metode perhitungan error\n";
-    cout << "(Variance, Mean Absolute Deviation (MAD), Max Pixel Difference, Entropy)\n\n";
+        format.channels = channels;
+        unpackImage(data, width, height, channels, format.sampleMax, image);
+        stbi_image_free(data);
+        return true;
+    }
+}
 
-    while (true)
+namespace
+{
+    // stb has no QOI reader
+    bool decodeQoi(const unsigned char* bytes, size_t size, vector<vector<RGB>>& image, ImageFormat& format)
     {
-        errorMethodStr = getNonEmptyLine("Metode error: ");
-        transform(errorMethodStr.begin(), errorMethodStr.end(), errorMethodStr.begin(), ::tolower);
-        if (isValidErrorMethod(errorMethodStr))
+        vector<uint8_t> pixels;
+        int width, height, channels;
+        if (!Qoi::decode(bytes, size, pixels, width, height, channels))
         {
-            method = parseErrorMethod(errorMethodStr);
-            break;
+            return false;
         }
-        cout << "\nMetode tidak dikenali. Coba lagi.\n";
+        format = ImageFormat();
+        format.channels = channels;
+        unpackImage(pixels.data(), width, height, channels, format.sampleMax, image);
+        return true;
     }
+}
 
-    cout << endl;
-
-    // Threshold
-    while (true)
+bool loadImage(const string& imagePath, vector<vector<RGB>>& image, ImageFormat& format)
+{
+    if (hasExtension(imagePath, ".qoi"))
     {
-        cout << "Masukkan nilai threshold: ";
-        string line;
-        getline(cin, line);
-        stringstream ss(line);
-        if (ss >> threshold && isValidThreshold(method, threshold)) break;
-        cout << "\nInput tidak valid. Masukkan angka desimal yang sesuai untuk threshold.\n\n";
+        ifstream file(imagePath, ios::binary);
+        vector<uint8_t> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        return decodeQoi(bytes.data(), bytes.size(), image, format);
     }
+    return decodeImage(FileSource{imagePath.c_str()}, image, format);
+}
 
-    cout << endl;
-
-    // Ukuran blok minimum
-    while (true)
+bool loadImageFromMemory(const unsigned char* bytes, size_t size, vector<vector<RGB>>& image, ImageFormat& format)
+{
+    if (bytes == nullptr || size == 0 || size > static_cast<size_t>(INT_MAX))
     {
-        cout << "Masukkan ukuran blok minimum: ";
-        string line;
-        getline(cin, line);
-        stringstream ss(line);
-        if (ss >> minBlockSize && minBlockSize > 1) break;
-        cout << "\nInput tidak valid. Masukkan bilangan bulat > 1.\n\n";
+        return false;
     }
-
-    cout << endl;
-
-    // Baca dan proses gambar
-    if (!processImage(inputImagePath, image))
+    if (Qoi::isQoi(bytes, size))
     {
-        cerr << "Gagal memproses gambar. Program dihentikan.\n";
-        exit(EXIT_FAILURE);
+        return decodeQoi(bytes, size, image, format);
     }
+    return decodeImage(MemorySource{bytes, static_cast<int>(size)}, image, format);
+}
+
+long long getFileSize(const string& path)
+{
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) return -1;
+    return static_cast<long long>(file.tellg());
 }
 
-void saveCompressedImage(const vector<vector<RGB>>& image, const string& outputImagePath)
+bool writeImage(const vector<vector<RGB>>& image, const string& outputImagePath, const ImageFormat& format)
 {
     if (image.empty() || image[0].empty()) {
-        std::cerr << "Galat: Data gambar kosong. Tidak dapat menyimpan.\n";
-        return;
+        return false;
     }
 
     const int height = static_cast<int>(image.size());
     const int width = static_cast<int>(image[0].size());
-    const int channels = 3; // RGB
-
-    // Siapkan buffer datar untuk menyimpan piksel dalam format RGB
-    std::vector<uint8_t> data(height * width * channels);
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            const RGB& pixel = image[y][x];
-            int idx = (y * width + x) * channels;
-            data[idx + 0] = static_cast<uint8_t>(pixel.r);
-            data[idx + 1] = static_cast<uint8_t>(pixel.g);
-            data[idx + 2] = static_cast<uint8_t>(pixel.b);
+    const int channels = (format.channels >= 1 && format.channels <= 4) ? format.channels : 3;
+
+    // Packing buffer stays warm across calls on the same thread
+    static thread_local std::vector<uint8_t> data;
+
+    if (hasExtension(outputImagePath, ".hdr"))
+    {
+        // stb addresses the float buffer with int offsets
+        if (static_cast<size_t>(height) * width * 3 > static_cast<size_t>(INT_MAX))
+        {
+            return false;
+        }
+        // Radiance output: undo the load-time scale, or linearize sRGB samples
+        const float inv = 1.0f / format.sampleMax;
+        std::vector<float> radiance(static_cast<size_t>(height) * width * 3);
+        for (int y = 0; y < height; ++y) {
+            float* dst = radiance.data() + static_cast<size_t>(y) * width * 3;
+            for (int x = 0; x < width; ++x) {
+                const int v[3] = { image[y][x].r, image[y][x].g, image[y][x].b };
+                for (int k = 0; k < 3; ++k) {
+                    float c = v[k] * inv;
+                    dst[3 * x + k] = (format.hdrScale > 0.0f) ? v[k] / format.hdrScale
+                                   : (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+                }
+            }
         }
+        return stbi_write_hdr(outputImagePath.c_str(), width, height, 3, radiance.data()) != 0;
     }
 
-    // Simpan gambar ke file PNG
-    if (!stbi_write_png(outputImagePath.c_str(), width, height, channels, data.data(), width * channels)) {
-        std::cerr << "Gagal menyimpan gambar ke: " << outputImagePath << '\n';
-    } else {
-        std::cout << "Gambar berhasil disimpan ke: " << outputImagePath << '\n';
+    // The output extension picks the codec; anything else is written as PNG.
+    // stb's writers index with int, and each format has its own size cap.
+    const size_t packedBytes = static_cast<size_t>(width) * height * channels;
+    if (hasExtension(outputImagePath, ".jpg") || hasExtension(outputImagePath, ".jpeg"))
+    {
+        if (width > MAX_JPEG_DIMENSION || height > MAX_JPEG_DIMENSION)
+        {
+            return false;
+        }
+        packRows8(image, channels, format.sampleMax, data);
+        return stbi_write_jpg(outputImagePath.c_str(), width, height, channels, data.data(), JPEG_QUALITY) != 0;
+    }
+    if (hasExtension(outputImagePath, ".bmp"))
+    {
+        if (packedBytes > static_cast<size_t>(INT_MAX))
+        {
+            return false;
+        }
+        packRows8(image, channels, format.sampleMax, data);
+        return stbi_write_bmp(outputImagePath.c_str(), width, height, channels, data.data()) != 0;
+    }
+    if (hasExtension(outputImagePath, ".qoi"))
+    {
+        // QOI hanya mengenal RGB dan RGBA; gray sudah tercermin di r, g dan b
+        const int qoiChannels = (channels == 2 || channels == 4) ? 4 : 3;
+        packRows8(image, qoiChannels, format.sampleMax, data);
+        static thread_local vector<uint8_t> encoded;
+        if (!Qoi::encode(data.data(), width, height, qoiChannels, encoded))
+        {
+            return false;
+        }
+        ofstream file(outputImagePath, ios::binary);
+        file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<streamsize>(encoded.size()));
+        return file.good();
     }
-}
 
-void outputHandler(const string& outputImagePath, const string& inputImagePath,
-                   int maxDepth, int nodeCount, chrono::milliseconds duration)
-{
-    long long inputSizeKB = getFileSize(inputImagePath) / 1024;
-    long long outputSizeKB = getFileSize(outputImagePath) / 1024;
-
-    cout << "\n\n========================= HASIL KOMPRESI =========================\n\n";
-    cout << "Gambar keluaran berhasil disimpan ke : " << outputImagePath << '\n';
-    cout << "Durasi eksekusi kompresi             : " << duration.count() << " ms\n";
-    cout << "Ukuran gambar input                  : " << inputSizeKB << " KB\n";
-    cout << "Ukuran gambar output                 : " << outputSizeKB << " KB\n";
-    cout << "Rasio kompresi                       : " << (1.0 - (float(outputSizeKB) / float(inputSizeKB))) * 100 << "% reduction\n";
-    cout << "Kedalaman maksimum Quadtree          : " << maxDepth << '\n';
-    cout << "Jumlah total simpul Quadtree         : " << nodeCount << "\n\n";
-    cout << "=================================================================\n";
+    if (format.sampleMax > 255)
+    {
+        // 16-bit sampel disimpan sebagai PNG 16-bit agar kedalaman tidak hilang
+        packRows<2>(image, channels, data);
+        return PngWriter::write(outputImagePath, width, height, PngWriter::colorTypeFor(channels), 16, data);
+    }
+
+    // Siapkan buffer datar dengan jumlah kanal asli gambar
+    packRows<1>(image, channels, data);
+    if (packedBytes > static_cast<size_t>(INT_MAX))
+    {
+        return PngWriter::write(outputImagePath, width, height, PngWriter::colorTypeFor(channels), 8, data);
+    }
+
+    // Simpan gambar ke file PNG
+    return stbi_write_png(outputImagePath.c_str(), width, height, channels, data.data(), width * channels) != 0;
 }
@@ -0,0 +1,720 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "compressor.hpp"
+#include "quadtree.hpp"
+#include "leafcoder.hpp"
+#include "leafmerge.hpp"
+#include "utils.hpp"
+#include "thresholdsearch.hpp"
+#include "ratedistortion.hpp"
+#include "palette.hpp"
+
+using namespace std;
+
+// Regression checks run by ctest, one check per test so a failure names
+// what broke:
+//
+// quadtree_test <qtc|qoi|png16|nodecounts|update|alpha|merge|sequence|rd|threshold|palette> <folder test/>
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const string& what)
+    {
+        if (!condition)
+        {
+            cerr << "GAGAL: " << what << '\n';
+            ++failures;
+        }
+    }
+
+    const char* const SAMPLE_IMAGES[] = {
+        "miria.jpg", "miriaEntropy.jpg", "miriaMAD.jpg", "miriaMaxPixelDiff.jpg", "miriaVariance.jpg"
+    };
+
+    // Middle-of-range thresholds, the same ones quadtree_bench --all uses
+    const struct { ErrorMethod method; float threshold; const char* name; } METHODS[] = {
+        {Variance, 200.0f, "variance"}, {MAD, 20.0f, "mad"}, {MaxPixelDiff, 40.0f, "mpd"},
+        {Entropy, 5.0f, "entropy"}, {LumaVariance, 100.0f, "luma"}, {DeltaE, 8.0f, "deltae"}, {SSIM, 0.1f, "ssim"},
+    };
+
+    // Node counts at minSize 4, per image, method (as in METHODS) and split
+    // mode (quad, adaptive). The Variance, MAD, MaxPixelDiff and Entropy
+    // quad counts are those of the original implementation, except Variance
+    // on miriaEntropy.jpg and miriaMaxPixelDiff.jpg: it summed variance in
+    // float and gave 4157 where the exact numerator gives 4161.
+    const int NODE_COUNTS[5][7][2] = {
+        {{13385, 9077}, {6129, 1405}, {16973, 16025}, {1949, 1233}, {13061, 8783}, {11505, 5895}, {26269, 39935}},
+        {{4161, 1143}, {2237, 397}, {3993, 1507}, {217, 169}, {4073, 1179}, {3713, 1019}, {8077, 4821}},
+        {{6005, 1707}, {4317, 571}, {5773, 2219}, {33, 17}, {5985, 1745}, {5721, 1305}, {6129, 5217}},
+        {{4161, 1143}, {2237, 403}, {3989, 1493}, {93, 99}, {4073, 1235}, {3713, 1009}, {7029, 4601}},
+        {{8301, 2181}, {4769, 647}, {7885, 2949}, {33, 101}, {8241, 2133}, {7609, 1711}, {8721, 7017}},
+    };
+
+    // Deterministic pixels with flat patches, gradients and noise, so every
+    // kind of leaf shows up
+    vector<vector<RGB>> makeImage(int width, int height, int channels, int sampleMax, uint32_t seed)
+    {
+        vector<vector<RGB>> image(height, vector<RGB>(width));
+        uint32_t state = seed;
+        auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                int v[4];
+                for (int k = 0; k < 4; ++k)
+                {
+                    int base = ((x / 16 + y / 16 + k) % 3 == 0) ? sampleMax / 3 : (x * (k + 1) + y * 3) % (sampleMax + 1);
+                    int noise = ((x / 8) % 4 == 0) ? static_cast<int>(next() % 9) - 4 : 0;
+                    v[k] = min(max(base + noise * (sampleMax / 255), 0), sampleMax);
+                }
+                RGB& p = image[y][x];
+                p.r = v[0];
+                p.g = (channels >= 3) ? v[1] : v[0];
+                p.b = (channels >= 3) ? v[2] : v[0];
+                p.a = (channels == 2 || channels == 4) ? v[3] : sampleMax;
+            }
+        }
+        return image;
+    }
+
+    bool sameTree(const QuadTreeNode* a, const QuadTreeNode* b)
+    {
+        if (a == nullptr || b == nullptr)
+        {
+            return a == b;
+        }
+        const Rect& ra = a->getBounds();
+        const Rect& rb = b->getBounds();
+        if (ra.x != rb.x || ra.y != rb.y || ra.width != rb.width || ra.height != rb.height || a->isLeafNode() != b->isLeafNode())
+        {
+            return false;
+        }
+        if (a->isLeafNode())
+        {
+            RGB ca = a->getAvgColor(), cb = b->getAvgColor();
+            return ca.r == cb.r && ca.g == cb.g && ca.b == cb.b && ca.a == cb.a;
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!sameTree(a->getChild(i), b->getChild(i)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Compares the lanes the format stores; alpha of opaque images is not
+    // written and may hold either 255 or sampleMax
+    bool samePixels(const vector<vector<RGB>>& a, const vector<vector<RGB>>& b, int channels)
+    {
+        const bool alpha = (channels == 2 || channels == 4);
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t y = 0; y < a.size(); ++y)
+        {
+            if (a[y].size() != b[y].size())
+            {
+                return false;
+            }
+            for (size_t x = 0; x < a[y].size(); ++x)
+            {
+                const RGB& p = a[y][x];
+                const RGB& q = b[y][x];
+                if (p.r != q.r || p.g != q.g || p.b != q.b || (alpha && p.a != q.a))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void writeBytes(const string& path, const vector<uint8_t>& data)
+    {
+        ofstream out(path, ios::binary);
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    // .qtc decode must give back exactly the reconstructed image
+    void checkQtcRoundTrip(const vector<vector<RGB>>& image, const ImageFormat& format, ErrorMethod method, float threshold, SplitMode mode, const string& label)
+    {
+        const string path = "quadtree_test.qtc";
+        QuadTree tree;
+        tree.buildTree(image, 0, 0, image[0].size(), image.size(), method, threshold, 4, mode, format);
+        vector<vector<RGB>> expected = image;
+        tree.reconstructImage(expected);
+
+        vector<vector<RGB>> decoded;
+        ImageFormat decodedFormat;
+        check(LeafCoder::encode(tree, path), label + ": encode");
+        check(LeafCoder::decode(path, decoded, decodedFormat), label + ": decode");
+        check(decodedFormat.channels == format.channels && decodedFormat.sampleMax == format.sampleMax, label + ": format");
+        check(samePixels(expected, decoded, format.channels), label + ": piksel hasil decode");
+        remove(path.c_str());
+    }
+
+    int runQtc(const string& dir)
+    {
+        for (const char* name : SAMPLE_IMAGES)
+        {
+            vector<vector<RGB>> image;
+            ImageFormat format;
+            if (!loadImage(dir + "/" + name, image, format))
+            {
+                check(false, string("memuat ") + name);
+                continue;
+            }
+            for (SplitMode mode : {QuadSplit, AdaptiveSplit})
+            {
+                checkQtcRoundTrip(image, format, Variance, 200.0f, mode, string(name) + (mode == QuadSplit ? " quad" : " adaptive"));
+            }
+        }
+
+        // Every native channel count, at both depths
+        for (int channels = 1; channels <= 4; ++channels)
+        {
+            for (int sampleMax : {255, 65535})
+            {
+                ImageFormat format;
+                format.channels = channels;
+                format.sampleMax = sampleMax;
+                const string label = "sintetis " + to_string(channels) + " kanal, maks " + to_string(sampleMax);
+                vector<vector<RGB>> image = makeImage(97, 61, channels, sampleMax, 7u + channels);
+                checkQtcRoundTrip(image, format, MAD, 6.0f, QuadSplit, label + " quad");
+                checkQtcRoundTrip(image, format, MAD, 6.0f, AdaptiveSplit, label + " adaptive");
+            }
+        }
+
+        // Damaged files fail with a reason instead of decoding garbage
+        const string path = "quadtree_test_damaged.qtc";
+        ImageFormat format;
+        vector<vector<RGB>> image = makeImage(97, 61, 3, 255, 5u);
+        QuadTree tree;
+        tree.buildTree(image, 0, 0, image[0].size(), image.size(), Variance, 50.0f, 2, QuadSplit, format);
+        vector<uint8_t> data;
+        check(LeafCoder::encode(tree, data), "encode ke memori");
+        for (size_t cut : {data.size() - 1, data.size() / 2, static_cast<size_t>(24)})
+        {
+            writeBytes(path, vector<uint8_t>(data.begin(), data.begin() + cut));
+            vector<vector<RGB>> decoded;
+            ImageFormat decodedFormat;
+            string error;
+            check(!LeafCoder::decode(path, decoded, decodedFormat, &error) && !error.empty(),
+                  "file .qtc terpotong di " + to_string(cut) + " byte ditolak");
+        }
+
+        // A bare header asking for 2^20 x 2^20 pixels is rejected before allocating
+        vector<uint8_t> bogus(data.begin(), data.begin() + 4);
+        for (uint32_t v : {1u << 20, 1u << 20})
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                bogus.push_back(static_cast<uint8_t>(v >> (8 * i)));
+            }
+        }
+        bogus.insert(bogus.end(), data.begin() + 12, data.begin() + 22);
+        writeBytes(path, bogus);
+        vector<vector<RGB>> decoded;
+        ImageFormat decodedFormat;
+        string error;
+        check(!LeafCoder::decode(path, decoded, decodedFormat, &error) && !error.empty() && decoded.empty(),
+              "header .qtc 2^20 x 2^20 ditolak");
+        remove(path.c_str());
+        return failures;
+    }
+
+    void checkFileRoundTrip(const string& path, int channels, int sampleMax, int expectedChannels)
+    {
+        const string label = path + " " + to_string(channels) + " kanal";
+        ImageFormat format;
+        format.channels = channels;
+        format.sampleMax = sampleMax;
+        vector<vector<RGB>> image = makeImage(83, 45, channels, sampleMax, 11u + channels);
+
+        vector<vector<RGB>> loaded;
+        ImageFormat loadedFormat;
+        check(writeImage(image, path, format), label + ": tulis");
+        check(loadImage(path, loaded, loadedFormat), label + ": baca");
+        check(loadedFormat.channels == expectedChannels && loadedFormat.sampleMax == sampleMax, label + ": format");
+        check(samePixels(image, loaded, channels), label + ": piksel");
+        remove(path.c_str());
+    }
+
+    int runQoi()
+    {
+        // QOI stores RGB or RGBA; gray is mirrored into r, g and b on the way out
+        checkFileRoundTrip("quadtree_test.qoi", 3, 255, 3);
+        checkFileRoundTrip("quadtree_test.qoi", 4, 255, 4);
+        checkFileRoundTrip("quadtree_test.qoi", 1, 255, 3);
+        return failures;
+    }
+
+    int runPng16()
+    {
+        for (int channels = 1; channels <= 4; ++channels)
+        {
+            checkFileRoundTrip("quadtree_test.png", channels, 65535, channels);
+        }
+        return failures;
+    }
+
+    int runNodeCounts(const string& dir)
+    {
+        Compressor compressor;
+        for (int i = 0; i < 5; ++i)
+        {
+            if (!compressor.load(dir + "/" + SAMPLE_IMAGES[i]))
+            {
+                check(false, compressor.getLastError());
+                continue;
+            }
+            for (int m = 0; m < 7; ++m)
+            {
+                for (int mode = 0; mode < 2; ++mode)
+                {
+                    CompressOptions options;
+                    options.method = METHODS[m].method;
+                    options.threshold = METHODS[m].threshold;
+                    options.minSize = 4;
+                    options.splitMode = mode == 0 ? QuadSplit : AdaptiveSplit;
+                    const string label = string(SAMPLE_IMAGES[i]) + " " + METHODS[m].name + (mode == 0 ? " quad" : " adaptive");
+                    check(compressor.build(options), label + ": build");
+                    const int nodes = compressor.getStats().nodeCount;
+                    check(nodes == NODE_COUNTS[i][m][mode], label + ": " + to_string(nodes) + " simpul, seharusnya " + to_string(NODE_COUNTS[i][m][mode]));
+                    // The next build must still see the source, not this output
+                    check(compressor.reconstruct(), label + ": reconstruct");
+                }
+            }
+        }
+        return failures;
+    }
+
+    // Byte targets must fit the real .qtc size, PSNR targets the real PSNR
+    int runRateDistortion(const string& dir)
+    {
+        for (const char* name : {"miria.jpg", "miriaVariance.jpg"})
+        {
+            vector<vector<RGB>> image;
+            ImageFormat format;
+            if (!loadImage(dir + "/" + name, image, format))
+            {
+                check(false, string("memuat ") + name);
+                continue;
+            }
+            const int width = static_cast<int>(image[0].size()), height = static_cast<int>(image.size());
+            QuadTree tree;
+            tree.prepareRateDistortion(image, 0, 0, width, height, 2, format);
+
+            for (double bytes : {3000.0, 12000.0})
+            {
+                const string label = string(name) + " " + to_string(static_cast<int>(bytes)) + " byte";
+                RateDistortion::Result result;
+                check(RateDistortion::fit(tree, RateDistortion::Target{RateDistortion::TargetBytes, bytes}, result), label + ": target tercapai");
+                vector<uint8_t> data;
+                check(LeafCoder::encode(tree, data) && data.size() <= bytes, label + ": .qtc " + to_string(data.size()) + " byte");
+            }
+            for (double psnr : {26.0, 32.0})
+            {
+                const string label = string(name) + " psnr " + to_string(static_cast<int>(psnr));
+                RateDistortion::Result result;
+                check(RateDistortion::fit(tree, RateDistortion::Target{RateDistortion::TargetPSNR, psnr}, result), label + ": target tercapai");
+                vector<vector<RGB>> output;
+                QualityStats quality;
+                tree.reconstructImage(image, output, &quality);
+                check(quality.psnr >= psnr, label + ": PSNR " + to_string(quality.psnr));
+            }
+        }
+        return failures;
+    }
+
+    // quantize leaves at most N leaf colors, and the indexed PNG reloads as
+    // exactly the reconstructed image
+    int runPalette(const string& dir)
+    {
+        const string path = "quadtree_test_palette.png";
+        for (const char* name : {"miria.jpg", "miriaMAD.jpg"})
+        {
+            vector<vector<RGB>> image;
+            ImageFormat format;
+            if (!loadImage(dir + "/" + name, image, format))
+            {
+                check(false, string("memuat ") + name);
+                continue;
+            }
+            for (int colors : {2, 16, 256})
+            {
+                const string label = string(name) + " " + to_string(colors) + " warna";
+                QuadTree tree;
+                tree.buildTree(image, 0, 0, image[0].size(), image.size(), Variance, 50.0f, 2, QuadSplit, format);
+                const int used = Palette::quantize(tree, colors);
+
+                vector<QuadTreeNode*> leaves;
+                tree.collectLeaves(leaves);
+                vector<RGB> distinct;
+                for (const QuadTreeNode* leaf : leaves)
+                {
+                    RGB c = leaf->getAvgColor();
+                    auto same = [&c](const RGB& d) { return c.r == d.r && c.g == d.g && c.b == d.b && c.a == d.a; };
+                    if (find_if(distinct.begin(), distinct.end(), same) == distinct.end())
+                    {
+                        distinct.push_back(c);
+                    }
+                }
+                check(used <= colors && static_cast<int>(distinct.size()) <= used,
+                      label + ": " + to_string(distinct.size()) + " warna leaf, palet " + to_string(used));
+
+                vector<vector<RGB>> expected;
+                tree.reconstructImage(image, expected);
+                vector<vector<RGB>> loaded;
+                ImageFormat loadedFormat;
+                check(Palette::writeIndexed(tree, path), label + ": tulis PNG berpalet");
+                check(loadImage(path, loaded, loadedFormat) && samePixels(expected, loaded, format.channels), label + ": piksel PNG berpalet");
+            }
+        }
+        remove(path.c_str());
+        return failures;
+    }
+
+    // fit() must leave the tree buildTree gives for the threshold it reports,
+    // and that tree must reach the target
+    int runThreshold(const string& dir)
+    {
+        for (const char* name : {"miria.jpg", "miriaVariance.jpg"})
+        {
+            vector<vector<RGB>> image;
+            ImageFormat format;
+            if (!loadImage(dir + "/" + name, image, format))
+            {
+                check(false, string("memuat ") + name);
+                continue;
+            }
+            const int width = static_cast<int>(image[0].size()), height = static_cast<int>(image.size());
+            for (const auto& m : METHODS)
+            {
+                for (double target : {24.0, 29.0})
+                {
+                    const string label = string(name) + " " + m.name + " psnr " + to_string(static_cast<int>(target));
+                    QuadTree searched;
+                    searched.prepareThresholdSearch(image, 0, 0, width, height, m.method, 4, format);
+                    ThresholdSearch::Result result;
+                    check(ThresholdSearch::fit(searched, ThresholdSearch::TargetPSNR, target, result), label + ": target tercapai");
+
+                    QuadTree built;
+                    built.buildTree(image, 0, 0, width, height, m.method, result.threshold, 4, QuadSplit, format);
+                    check(built.getNodeCount() == searched.getNodeCount(),
+                          label + ": " + to_string(searched.getNodeCount()) + " simpul, buildTree memberi " + to_string(built.getNodeCount()));
+
+                    vector<vector<RGB>> output;
+                    QualityStats quality;
+                    searched.reconstructImage(image, output, &quality);
+                    check(quality.psnr >= target, label + ": PSNR " + to_string(quality.psnr));
+                }
+
+                const string label = string(name) + " " + m.name + " ssim";
+                QuadTree searched;
+                searched.prepareThresholdSearch(image, 0, 0, width, height, m.method, 4, format);
+                ThresholdSearch::Result result;
+                check(ThresholdSearch::fit(searched, ThresholdSearch::TargetSSIM, 0.8, result), label + ": target tercapai");
+                vector<vector<RGB>> output;
+                QualityStats quality;
+                searched.reconstructImage(image, output, &quality);
+                check(quality.ssim >= 0.8, label + ": SSIM " + to_string(quality.ssim));
+            }
+        }
+
+        // Thresholds right at the cached errors, where a replay that differs
+        // from the stop rule buildTree uses would first show
+        ImageFormat format;
+        vector<vector<RGB>> image = makeImage(97, 61, 3, 255, 3u);
+        for (ErrorMethod method : {Variance, MAD})
+        {
+            QuadTree searched;
+            searched.prepareThresholdSearch(image, 0, 0, 97, 61, method, 2, format);
+            vector<float> errors;
+            searched.collectSplitErrors(errors);
+            int mismatches = 0;
+            for (float error : errors)
+            {
+                for (float threshold : {error, nextafterf(error, numeric_limits<float>::infinity())})
+                {
+                    searched.pruneThreshold(threshold);
+                    QuadTree built;
+                    built.buildTree(image, 0, 0, 97, 61, method, threshold, 2, QuadSplit, format);
+                    mismatches += built.getNodeCount() != searched.getNodeCount();
+                }
+            }
+            check(mismatches == 0, string(method == Variance ? "variance" : "mad") + ": " + to_string(mismatches) + " threshold memberi tree berbeda dari buildTree");
+        }
+        return failures;
+    }
+
+    // Paints an edit into the rectangle: a flat patch with a noisy stripe
+    void paint(vector<vector<RGB>>& image, const Rect& r, int sampleMax, uint32_t seed)
+    {
+        uint32_t state = seed;
+        for (int y = r.y; y < r.y + r.height; ++y)
+        {
+            for (int x = r.x; x < r.x + r.width; ++x)
+            {
+                state = state * 1664525u + 1013904223u;
+                int v = (y - r.y < r.height / 3) ? static_cast<int>((state >> 8) % (sampleMax + 1)) : sampleMax / 5;
+                image[y][x].r = v;
+                image[y][x].g = sampleMax - v;
+                image[y][x].b = v / 2;
+            }
+        }
+    }
+
+    int runUpdate(const string& dir)
+    {
+        vector<vector<RGB>> image;
+        ImageFormat format;
+        if (!loadImage(dir + "/miria.jpg", image, format))
+        {
+            check(false, "memuat miria.jpg");
+            return failures;
+        }
+        const int width = static_cast<int>(image[0].size());
+        const int height = static_cast<int>(image.size());
+        const Rect edits[] = {
+            {width / 3, height / 4, 64, 64},
+            {0, 0, width / 2, 40},
+            {width - 17, height - 33, 17, 33},
+        };
+
+        // Luma Variance and Delta E read float tables that are patched in
+        // place, so they are only equal up to rounding and are left out
+        for (const auto& m : METHODS)
+        {
+            if (m.method == LumaVariance || m.method == DeltaE)
+            {
+                continue;
+            }
+            for (SplitMode mode : {QuadSplit, AdaptiveSplit})
+            {
+                vector<vector<RGB>> edited = image;
+                QuadTree incremental;
+                incremental.buildTree(edited, 0, 0, width, height, m.method, m.threshold, 4, mode, format);
+                uint32_t seed = 1;
+                for (const Rect& edit : edits)
+                {
+                    paint(edited, edit, format.sampleMax, seed++);
+                    incremental.update(edited, edit);
+
+                    QuadTree rebuilt;
+                    rebuilt.buildTree(edited, 0, 0, width, height, m.method, m.threshold, 4, mode, format);
+                    check(sameTree(incremental.getRoot(), rebuilt.getRoot()),
+                          string(m.name) + (mode == QuadSplit ? " quad" : " adaptive") + ": update != buildTree setelah edit " + to_string(seed - 1));
+                }
+            }
+        }
+        return failures;
+    }
+
+    // Color is flat and only alpha varies: every method must see the edge
+    int runAlpha()
+    {
+        for (int channels : {2, 4})
+        {
+            ImageFormat format;
+            format.channels = channels;
+            vector<vector<RGB>> image(64, vector<RGB>(64, RGB{90, 120, 150, 255}));
+            for (int y = 0; y < 64; ++y)
+            {
+                for (int x = 40; x < 64; ++x)
+                {
+                    image[y][x].a = 0;
+                }
+                for (auto& p : image[y])
+                {
+                    if (channels == 2) p.g = p.b = p.r;
+                }
+            }
+            for (const auto& m : METHODS)
+            {
+                for (SplitMode mode : {QuadSplit, AdaptiveSplit})
+                {
+                    QuadTree tree;
+                    tree.buildTree(image, 0, 0, 64, 64, m.method, m.method == Entropy ? 0.1f : m.threshold / 4, 4, mode, format);
+                    const string label = string(m.name) + (mode == QuadSplit ? " quad " : " adaptive ") + to_string(channels) + " kanal";
+                    check(tree.getNodeCount() > 1, label + ": tepi alpha tidak terlihat");
+
+                    vector<vector<RGB>> output;
+                    tree.reconstructImage(image, output);
+                    check(output[10][10].a == 255 && output[10][60].a == 0, label + ": alpha hasil rekonstruksi");
+                }
+            }
+        }
+        return failures;
+    }
+
+    // Merged regions collapse the tree, code each region color once in .qtc
+    // and still decode to the reconstructed image
+    int runMerge(const string& dir)
+    {
+        vector<vector<RGB>> image;
+        ImageFormat format;
+        if (!loadImage(dir + "/miria.jpg", image, format))
+        {
+            check(false, "memuat miria.jpg");
+            return failures;
+        }
+        const int width = static_cast<int>(image[0].size());
+        const int height = static_cast<int>(image.size());
+
+        for (const auto& m : METHODS)
+        {
+            if (m.method == Entropy)
+            {
+                continue;
+            }
+            for (SplitMode mode : {QuadSplit, AdaptiveSplit})
+            {
+                const string label = string(m.name) + (mode == QuadSplit ? " quad" : " adaptive");
+                QuadTree tree;
+                tree.buildTree(image, 0, 0, width, height, m.method, m.threshold, 4, mode, format);
+                const int nodesBefore = tree.getNodeCount();
+                vector<uint8_t> plain;
+                check(LeafCoder::encode(tree, plain), label + ": encode tanpa region");
+
+                const int regions = LeafMerge::mergeLeaves(tree, image);
+                vector<QuadTreeNode*> leaves;
+                tree.collectLeaves(leaves);
+                check(regions > 0 && regions == tree.getRegionCount() && tree.getLeafRegions().size() == leaves.size(), label + ": daftar region");
+                check(tree.getNodeCount() <= nodesBefore, label + ": subtree satu region tidak diciutkan");
+
+                vector<uint8_t> merged;
+                check(LeafCoder::encode(tree, merged), label + ": encode dengan region");
+                check(merged.size() < plain.size(), label + ": .qtc dengan region tidak lebih kecil");
+
+                const string path = "quadtree_test_merge.qtc";
+                vector<vector<RGB>> expected, decoded;
+                ImageFormat decodedFormat;
+                tree.reconstructImage(image, expected);
+                check(LeafCoder::encode(tree, path) && LeafCoder::decode(path, decoded, decodedFormat), label + ": round-trip .qtc");
+                check(samePixels(expected, decoded, format.channels), label + ": piksel hasil decode");
+                remove(path.c_str());
+            }
+        }
+
+        Compressor compressor;
+        CompressOptions options;
+        options.method = Entropy;
+        options.threshold = 5.0f;
+        options.mergeLeaves = true;
+        check(compressor.setImage(image, format) && !compressor.build(options), "entropy + merge harus ditolak");
+        return failures;
+    }
+
+    // Frames carried over with updateFromFrame decode to the reconstructed
+    // tree; sensor noise alone rebuilds little, and a frame gone flat
+    // collapses back to one leaf
+    int runSequence(const string& dir)
+    {
+        vector<vector<RGB>> image;
+        ImageFormat format;
+        if (!loadImage(dir + "/miria.jpg", image, format))
+        {
+            check(false, "memuat miria.jpg");
+            return failures;
+        }
+        const int width = static_cast<int>(image[0].size());
+        const int height = static_cast<int>(image.size());
+
+        for (const auto& m : {METHODS[0], METHODS[1]})
+        {
+            const string label = m.name;
+            QuadTree tree;
+            tree.buildTree(image, 0, 0, width, height, m.method, m.threshold, 4, QuadSplit, format);
+            vector<QuadTreeNode*> rebuilt{tree.getRoot()};
+            vector<vector<RGB>> canvas, decoded, expected;
+            vector<uint8_t> data;
+            ImageFormat decodedFormat;
+            check(LeafCoder::encodeFrame(tree, rebuilt, true, canvas, data) && LeafCoder::decodeFrame(data, decoded, decodedFormat),
+                  label + ": keyframe");
+
+            vector<vector<RGB>> previous = image;
+            uint32_t state = 5;
+            for (int frame = 1; frame <= 3; ++frame)
+            {
+                vector<vector<RGB>> current = image;
+                for (auto& row : current)
+                {
+                    for (RGB& p : row)
+                    {
+                        for (int* c : {&p.r, &p.g, &p.b})
+                        {
+                            state = state * 1664525u + 1013904223u;
+                            *c = min(max(*c + static_cast<int>((state >> 24) % 5) - 2, 0), 255);
+                        }
+                    }
+                }
+                paint(current, Rect{frame * 40, 50, 60, 60}, format.sampleMax, static_cast<uint32_t>(frame));
+
+                tree.updateFromFrame(previous, current, rebuilt);
+                long long area = 0;
+                for (const QuadTreeNode* subtree : rebuilt)
+                {
+                    area += 1LL * subtree->getBounds().width * subtree->getBounds().height;
+                }
+                check(!rebuilt.empty() && area < 1LL * width * height / 10, label + ": derau membangun ulang terlalu banyak, frame " + to_string(frame));
+
+                check(LeafCoder::encodeFrame(tree, rebuilt, false, canvas, data) && LeafCoder::decodeFrame(data, decoded, decodedFormat),
+                      label + ": delta frame " + to_string(frame));
+                tree.reconstructImage(current, expected);
+                check(samePixels(expected, decoded, format.channels), label + ": piksel delta frame " + to_string(frame));
+                previous.swap(current);
+            }
+
+            vector<vector<RGB>> flat(height, vector<RGB>(width, RGB{40, 80, 120, 255}));
+            tree.updateFromFrame(previous, flat, rebuilt);
+            check(tree.getRoot()->isLeafNode() && rebuilt.size() == 1, label + ": frame datar tidak diciutkan ke satu leaf");
+        }
+        return failures;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "Penggunaan: " << argv[0] << " <qtc|qoi|png16|nodecounts|update|alpha|merge|sequence|rd|threshold|palette> <folder test/>\n";
+        return EXIT_FAILURE;
+    }
+
+    const string name = argv[1];
+    const string dir = argv[2];
+    int result = -1;
+    if (name == "qtc") result = runQtc(dir);
+    else if (name == "qoi") result = runQoi();
+    else if (name == "png16") result = runPng16();
+    else if (name == "nodecounts") result = runNodeCounts(dir);
+    else if (name == "update") result = runUpdate(dir);
+    else if (name == "alpha") result = runAlpha();
+    else if (name == "merge") result = runMerge(dir);
+    else if (name == "sequence") result = runSequence(dir);
+    else if (name == "rd") result = runRateDistortion(dir);
+    else if (name == "threshold") result = runThreshold(dir);
+    else if (name == "palette") result = runPalette(dir);
+
+    if (result < 0)
+    {
+        cerr << "Pemeriksaan tidak dikenali: " << name << '\n';
+        return EXIT_FAILURE;
+    }
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}